@@ -0,0 +1,77 @@
+#include "bit_set.h"
+#include "cpu_features.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define BIT_SET_HAS_X86_64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define BIT_SET_TARGET_AVX2
+#else
+#define BIT_SET_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+	inline uint32_t LowestBit(uint64_t word) {
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward64(&index, word);
+		return static_cast<uint32_t>(index);
+#else
+		return static_cast<uint32_t>(__builtin_ctzll(word));
+#endif
+	}
+
+	inline void AppendBits(uint64_t word, uint32_t base, std::vector<uint32_t>& out) {
+		while (word != 0u) {
+			out.push_back(base + LowestBit(word));
+			word &= word - 1u;
+		}
+	}
+
+	void IntersectBitSetsScalar(const uint64_t* lhs, const uint64_t* rhs, size_t words, std::vector<uint32_t>& out) {
+		for (size_t i = 0; i < words; ++i) {
+			AppendBits(lhs[i] & rhs[i], static_cast<uint32_t>(i * 64u), out);
+		}
+	}
+
+#ifdef BIT_SET_HAS_X86_64
+	// Blocks without a common bit, most of them for sparse rows, are skipped with a single test.
+	BIT_SET_TARGET_AVX2 void IntersectBitSetsAvx2(const uint64_t* lhs, const uint64_t* rhs, size_t words, std::vector<uint32_t>& out) {
+		alignas(32) uint64_t block[BIT_SET_BLOCK_WORDS];
+		for (size_t i = 0; i < words; i += BIT_SET_BLOCK_WORDS) {
+			const __m256i common = _mm256_and_si256(
+				_mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i)),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + i))
+			);
+			if (_mm256_testz_si256(common, common)) {
+				continue;
+			}
+			_mm256_store_si256(reinterpret_cast<__m256i*>(block), common);
+			for (size_t j = 0; j < BIT_SET_BLOCK_WORDS; ++j) {
+				AppendBits(block[j], static_cast<uint32_t>((i + j) * 64u), out);
+			}
+		}
+	}
+#endif
+
+	using IntersectBitSetsFn = void (*)(const uint64_t*, const uint64_t*, size_t, std::vector<uint32_t>&);
+
+	IntersectBitSetsFn SelectIntersectBitSets() {
+#ifdef BIT_SET_HAS_X86_64
+		if (CpuHasAvx2()) {
+			return IntersectBitSetsAvx2;
+		}
+#endif
+		return IntersectBitSetsScalar;
+	}
+}
+
+void IntersectBitSets(const uint64_t* lhs, const uint64_t* rhs, size_t words, std::vector<uint32_t>& out) {
+	static const IntersectBitSetsFn intersect = SelectIntersectBitSets();
+	intersect(lhs, rhs, words, out);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Rows of bit matrices are padded to whole 256-bit blocks, so every row of a 32-byte aligned matrix
+// is aligned too and the AVX2 kernel needs no tail loop.
+constexpr size_t BIT_SET_BLOCK_WORDS = 4u;
+
+// Words of a row of count bits, a multiple of BIT_SET_BLOCK_WORDS.
+inline size_t BitSetWords(size_t count) {
+	const size_t words = (count + 63u) / 64u;
+	return (words + BIT_SET_BLOCK_WORDS - 1u) / BIT_SET_BLOCK_WORDS * BIT_SET_BLOCK_WORDS;
+}
+
+inline void SetBit(uint64_t* row, size_t bit) {
+	row[bit / 64u] |= uint64_t{ 1 } << (bit % 64u);
+}
+
+// Appends to out the positions of the bits set in both lhs and rhs, ascending. words has to be a
+// multiple of BIT_SET_BLOCK_WORDS. Uses an AVX2 kernel when the CPU supports it and a scalar loop otherwise.
+void IntersectBitSets(const uint64_t* lhs, const uint64_t* rhs, size_t words, std::vector<uint32_t>& out);
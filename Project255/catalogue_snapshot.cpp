@@ -0,0 +1,337 @@
+#include "catalogue_snapshot.h"
+#include "bit_set.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+
+namespace snapshot {
+
+	namespace {
+		constexpr size_t AlignUp(size_t offset) {
+			return (offset + SECTION_ALIGNMENT - 1u) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+		}
+
+		constexpr size_t PayloadBegin() {
+			return AlignUp(sizeof(Header) + sizeof(SectionEntry) * SECTION_COUNT);
+		}
+	}
+
+	uint64_t Checksum(const void* data, size_t size) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		uint64_t hash = 14695981039346656037ULL;
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+			uint64_t word;
+			std::memcpy(&word, bytes + i, sizeof(word));
+			hash = (hash ^ word) * 1099511628211ULL;
+			hash ^= hash >> 32;
+		}
+		for (; i < size; ++i) {
+			hash = (hash ^ bytes[i]) * 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	Writer::Writer() : _payloads(SECTION_COUNT, Payload{ nullptr, 0u }) {}
+
+	void Writer::Add(Section section, const void* data, size_t size) {
+		_payloads[static_cast<size_t>(section)] = { data, size };
+	}
+
+	void Writer::Save(const std::string& path) const {
+		SectionEntry sections[SECTION_COUNT];
+		size_t offset = PayloadBegin();
+		for (size_t i = 0; i < SECTION_COUNT; ++i) {
+			sections[i] = { offset, _payloads[i].size, Checksum(_payloads[i].data, _payloads[i].size) };
+			offset = AlignUp(offset + _payloads[i].size);
+		}
+
+		Header header{};
+		std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version = VERSION;
+		header.byte_order = BYTE_ORDER_MARK;
+		header.section_count = static_cast<uint32_t>(SECTION_COUNT);
+		header.file_size = offset;
+		header.checksum = Checksum(sections, sizeof(sections));
+
+		// Written next to the target and renamed over it, so readers never observe a partial file.
+		const std::string tmp_path = path + ".tmp"s;
+		{
+			std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+			if (!out) {
+				throw std::runtime_error("Cannot create snapshot file "s + tmp_path);
+			}
+			const char zeros[SECTION_ALIGNMENT] = {};
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(reinterpret_cast<const char*>(sections), sizeof(sections));
+			size_t written = sizeof(header) + sizeof(sections);
+			for (size_t i = 0; i < SECTION_COUNT; ++i) {
+				out.write(zeros, static_cast<std::streamsize>(sections[i].offset - written));
+				out.write(static_cast<const char*>(_payloads[i].data), static_cast<std::streamsize>(_payloads[i].size));
+				written = sections[i].offset + _payloads[i].size;
+			}
+			out.write(zeros, static_cast<std::streamsize>(header.file_size - written));
+			if (!out) {
+				throw std::runtime_error("Cannot write snapshot file "s + tmp_path);
+			}
+		}
+		std::filesystem::rename(tmp_path, path);
+	}
+
+	Image::Image(const char* data, size_t size, Verification verification) : _data(data) {
+		if (size < PayloadBegin()) {
+			throw FormatError("Snapshot is truncated"s);
+		}
+		Header header;
+		std::memcpy(&header, data, sizeof(header));
+		if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+			throw FormatError("Not a catalogue snapshot"s);
+		}
+		if (header.version != VERSION) {
+			throw FormatError("Unsupported snapshot version "s + std::to_string(header.version));
+		}
+		if (header.byte_order != BYTE_ORDER_MARK) {
+			throw FormatError("Snapshot was written with a different byte order"s);
+		}
+		if (header.section_count != SECTION_COUNT || header.file_size != size) {
+			throw FormatError("Snapshot is truncated or has an unexpected layout"s);
+		}
+		std::memcpy(_sections, data + sizeof(header), sizeof(_sections));
+		if (Checksum(_sections, sizeof(_sections)) != header.checksum) {
+			throw FormatError("Snapshot section table is corrupted"s);
+		}
+		for (const SectionEntry& entry : _sections) {
+			if (entry.offset % SECTION_ALIGNMENT != 0u || entry.offset > size || entry.size > size - entry.offset) {
+				throw FormatError("Snapshot section is out of bounds"s);
+			}
+			if (verification == Verification::Full && Checksum(data + entry.offset, static_cast<size_t>(entry.size)) != entry.checksum) {
+				throw FormatError("Snapshot section is corrupted"s);
+			}
+		}
+	}
+
+	std::vector<char> ReadFile(const std::string& path) {
+		std::ifstream in(path, std::ios::binary | std::ios::ate);
+		if (!in) {
+			throw std::runtime_error("Cannot open snapshot file "s + path);
+		}
+		std::vector<char> res(static_cast<size_t>(in.tellg()));
+		in.seekg(0);
+		in.read(res.data(), static_cast<std::streamsize>(res.size()));
+		if (!in) {
+			throw std::runtime_error("Cannot read snapshot file "s + path);
+		}
+		return res;
+	}
+
+	void CheckLayout(const Image& image, Verification verification) {
+		const bool full = verification == Verification::Full;
+		auto check = [](bool condition) {
+			if (!condition) {
+				throw FormatError("Snapshot sections are inconsistent"s);
+			}
+		};
+		auto check_offsets = [&](Span<uint32_t> offsets, size_t count, size_t total) {
+			check(offsets.size() == count + 1u && offsets.front() == 0u && offsets.back() == total);
+			for (size_t i = 0; full && i < count; ++i) {
+				check(offsets[i] <= offsets[i + 1u]);
+			}
+		};
+		auto check_indices = [&](Span<uint32_t> indices, size_t count) {
+			for (size_t i = 0; full && i < indices.size(); ++i) {
+				check(indices[i] < count);
+			}
+		};
+		// Open addressing needs a power-of-two capacity and at least one empty slot to stop probing.
+		auto check_index = [&](Span<uint32_t> slots, size_t count) {
+			check((slots.size() & (slots.size() - 1u)) == 0u && (slots.empty() ? count == 0u : count < slots.size()));
+			size_t used = 0;
+			for (size_t i = 0; full && i < slots.size(); ++i) {
+				if (slots[i] != StringPoolRef::NPOS) {
+					check((slots[i] & ~StringPoolRef::ERASED) < count);
+					++used;
+				}
+			}
+			check(!full || used == count);
+		};
+
+		Span<uint32_t> stop_name_offsets = image.Get<uint32_t>(Section::StopNameOffsets);
+		Span<uint32_t> bus_name_offsets = image.Get<uint32_t>(Section::BusNameOffsets);
+		check(!stop_name_offsets.empty() && !bus_name_offsets.empty());
+		const size_t stop_count = stop_name_offsets.size() - 1u;
+		const size_t bus_count = bus_name_offsets.size() - 1u;
+		check_offsets(stop_name_offsets, stop_count, image.Get<char>(Section::StopNameChars).size());
+		check_offsets(bus_name_offsets, bus_count, image.Get<char>(Section::BusNameChars).size());
+		check_index(image.Get<uint32_t>(Section::StopNameIndex), stop_count);
+		check_index(image.Get<uint32_t>(Section::BusNameIndex), bus_count);
+
+		Span<StopIdx> route_stops = image.Get<StopIdx>(Section::RouteStops);
+		check_offsets(image.Get<uint32_t>(Section::RouteOffsets), bus_count, route_stops.size());
+		check_indices(route_stops, stop_count);
+		check(image.Get<uint8_t>(Section::RouteCircle).size() == bus_count);
+
+		Span<BusIdx> stop_buses = image.Get<BusIdx>(Section::StopBuses);
+		check_offsets(image.Get<uint32_t>(Section::StopBusOffsets), stop_count, stop_buses.size());
+		check_indices(stop_buses, bus_count);
+
+		Span<uint64_t> keys = image.Get<uint64_t>(Section::RoadDistanceKeys);
+		Span<RoadDistance> values = image.Get<RoadDistance>(Section::RoadDistanceValues);
+		check((keys.size() & (keys.size() - 1u)) == 0u && values.size() == keys.size());
+		size_t used = 0;
+		for (size_t i = 0; full && i < keys.size(); ++i) {
+			if (keys[i] != RoadDistanceTable::EMPTY_KEY) {
+				check((keys[i] >> 32) < stop_count && (keys[i] & 0xFFFFFFFFu) < stop_count);
+				unsigned char is_reverse;
+				std::memcpy(&is_reverse, reinterpret_cast<const char*>(&values[i]) + offsetof(RoadDistance, is_reverse), 1u);
+				check(is_reverse <= 1u);
+				++used;
+			}
+		}
+		check(!full || keys.empty() || used < keys.size());
+
+		check(image.Get<double>(Section::StopLat).size() == stop_count);
+		check(image.Get<double>(Section::StopLng).size() == stop_count);
+		check(image.Get<double>(Section::StopSinLat).size() == stop_count);
+		check(image.Get<double>(Section::StopCosLat).size() == stop_count);
+		check(image.Get<RouteStats>(Section::RouteStats).size() == bus_count);
+		Span<uint32_t> route_sum_offsets = image.Get<uint32_t>(Section::RouteSumOffsets);
+		Span<double> route_distance_sums = image.Get<double>(Section::RouteDistanceSums);
+		check_offsets(route_sum_offsets, bus_count, route_distance_sums.size());
+		check(image.Get<double>(Section::RouteLengthSums).size() == route_distance_sums.size());
+		if (full) {
+			// findRouteSection() reads the sums at positions taken from the route itself.
+			Span<uint32_t> route_offsets = image.Get<uint32_t>(Section::RouteOffsets);
+			Span<uint8_t> route_circle = image.Get<uint8_t>(Section::RouteCircle);
+			for (size_t bus = 0; bus < bus_count; ++bus) {
+				RouteRef route{ route_stops.subspan(route_offsets[bus], route_offsets[bus + 1u] - route_offsets[bus]), route_circle[bus] != 0 };
+				const size_t positions = route.stops.empty() ? 0u : RideSegmentCount(route) + 1u;
+				check(route_sum_offsets[bus + 1u] - route_sum_offsets[bus] == positions);
+			}
+		}
+
+		// Bits past the bus count would be reported as buses.
+		Span<uint64_t> stop_bus_bits = image.Get<uint64_t>(Section::StopBusBits);
+		const size_t bus_words = BitSetWords(bus_count);
+		check(stop_bus_bits.size() == stop_count * bus_words);
+		for (size_t stop = 0; full && stop < stop_count; ++stop) {
+			for (size_t word = bus_count / 64u; word < bus_words; ++word) {
+				const uint64_t padding = word == bus_count / 64u ? ~uint64_t{ 0 } << (bus_count % 64u) : ~uint64_t{ 0 };
+				check((stop_bus_bits[stop * bus_words + word] & padding) == 0u);
+			}
+		}
+		Span<uint64_t> transfer_keys = image.Get<uint64_t>(Section::TransferKeys);
+		Span<TransferRange> transfer_values = image.Get<TransferRange>(Section::TransferValues);
+		Span<StopIdx> transfer_stops = image.Get<StopIdx>(Section::TransferStops);
+		check((transfer_keys.size() & (transfer_keys.size() - 1u)) == 0u && transfer_values.size() == transfer_keys.size());
+		size_t transfer_pairs = 0;
+		for (size_t i = 0; full && i < transfer_keys.size(); ++i) {
+			if (transfer_keys[i] != TransferTable::EMPTY_KEY) {
+				check((transfer_keys[i] >> 32) < bus_count && (transfer_keys[i] & 0xFFFFFFFFu) < bus_count);
+				check(transfer_values[i].offset <= transfer_stops.size() && transfer_values[i].count <= transfer_stops.size() - transfer_values[i].offset);
+				++transfer_pairs;
+			}
+		}
+		check(!full || transfer_keys.empty() || transfer_pairs < transfer_keys.size());
+		check_indices(transfer_stops, stop_count);
+		check(image.Get<GeoBounds>(Section::StopBounds).size() == 1u);
+
+		Span<StopGrid> grid = image.Get<StopGrid>(Section::StopGrid);
+		check(grid.size() == 1u && grid[0].rows > 0u && grid[0].cols > 0u && grid[0].cell_lat > 0.0 && grid[0].cell_lng > 0.0);
+		Span<StopIdx> grid_stops = image.Get<StopIdx>(Section::GridStops);
+		check(grid_stops.size() <= stop_count);
+		check_offsets(image.Get<uint32_t>(Section::GridCellOffsets), size_t{ grid[0].rows } * grid[0].cols, grid_stops.size());
+		check_indices(grid_stops, stop_count);
+
+		// The routing hierarchy is optional: either every routing section is empty or none is.
+		Span<RoutingHierarchyInfo> routing = image.Get<RoutingHierarchyInfo>(Section::RoutingInfo);
+		Span<BusIdx> call_buses = image.Get<BusIdx>(Section::RoutingCallBuses);
+		Span<uint32_t> up_offsets = image.Get<uint32_t>(Section::RoutingUpOffsets);
+		Span<HierarchyEdge> up_edges = image.Get<HierarchyEdge>(Section::RoutingUpEdges);
+		Span<uint32_t> down_offsets = image.Get<uint32_t>(Section::RoutingDownOffsets);
+		Span<HierarchyEdge> down_edges = image.Get<HierarchyEdge>(Section::RoutingDownEdges);
+		check(routing.size() <= 1u);
+		if (routing.empty()) {
+			check(call_buses.empty() && up_offsets.empty() && up_edges.empty() && down_offsets.empty() && down_edges.empty());
+			return;
+		}
+		check(routing[0].stop_count == stop_count && routing[0].settings.bus_velocity > 0.0);
+		check_indices(call_buses, bus_count);
+		const size_t vertex_count = stop_count + call_buses.size();
+		auto check_edges = [&](Span<uint32_t> offsets, Span<HierarchyEdge> edges) {
+			check_offsets(offsets, vertex_count, edges.size());
+			for (size_t i = 0; full && i < edges.size(); ++i) {
+				check(edges[i].to < vertex_count && (edges[i].middle == HierarchyEdge::NO_VERTEX || edges[i].middle < vertex_count));
+				check(edges[i].weight >= 0.0 && edges[i].weight < std::numeric_limits<double>::infinity());
+			}
+		};
+		check_edges(up_offsets, up_edges);
+		check_edges(down_offsets, down_edges);
+	}
+
+	StringPoolRef StopNames(const Image& image) {
+		Span<uint32_t> offsets = image.Get<uint32_t>(Section::StopNameOffsets);
+		Span<uint32_t> index = image.Get<uint32_t>(Section::StopNameIndex);
+		return { image.Get<char>(Section::StopNameChars).data(), offsets.data(), index.data(), offsets.size() - 1u, index.size() };
+	}
+
+	StringPoolRef BusNames(const Image& image) {
+		Span<uint32_t> offsets = image.Get<uint32_t>(Section::BusNameOffsets);
+		Span<uint32_t> index = image.Get<uint32_t>(Section::BusNameIndex);
+		return { image.Get<char>(Section::BusNameChars).data(), offsets.data(), index.data(), offsets.size() - 1u, index.size() };
+	}
+
+	CatalogueView MakeView(const Image& image) {
+		CatalogueView res;
+		res.route_offsets = image.Get<uint32_t>(Section::RouteOffsets);
+		res.route_stops = image.Get<StopIdx>(Section::RouteStops);
+		res.route_circle = image.Get<uint8_t>(Section::RouteCircle);
+		res.stop_bus_offsets = image.Get<uint32_t>(Section::StopBusOffsets);
+		res.stop_buses = image.Get<BusIdx>(Section::StopBuses);
+		res.road_distance_keys = image.Get<uint64_t>(Section::RoadDistanceKeys);
+		res.road_distance_values = image.Get<RoadDistance>(Section::RoadDistanceValues);
+		res.stop_lat = image.Get<double>(Section::StopLat);
+		res.stop_lng = image.Get<double>(Section::StopLng);
+		res.stop_sin_lat = image.Get<double>(Section::StopSinLat);
+		res.stop_cos_lat = image.Get<double>(Section::StopCosLat);
+		res.route_stats = image.Get<RouteStats>(Section::RouteStats);
+		res.route_sum_offsets = image.Get<uint32_t>(Section::RouteSumOffsets);
+		res.route_distance_sums = image.Get<double>(Section::RouteDistanceSums);
+		res.route_length_sums = image.Get<double>(Section::RouteLengthSums);
+		res.stop_bus_bits = image.Get<uint64_t>(Section::StopBusBits);
+		res.transfer_keys = image.Get<uint64_t>(Section::TransferKeys);
+		res.transfer_values = image.Get<TransferRange>(Section::TransferValues);
+		res.transfer_stops = image.Get<StopIdx>(Section::TransferStops);
+		res.stop_bounds = image.Get<GeoBounds>(Section::StopBounds).front();
+		res.grid_cell_offsets = image.Get<uint32_t>(Section::GridCellOffsets);
+		res.grid_stops = image.Get<StopIdx>(Section::GridStops);
+		res.stop_grid = image.Get<StopGrid>(Section::StopGrid).front();
+		return res;
+	}
+
+	RoutingHierarchyView MakeRoutingHierarchy(const Image& image) {
+		RoutingHierarchyView res;
+		Span<RoutingHierarchyInfo> info = image.Get<RoutingHierarchyInfo>(Section::RoutingInfo);
+		if (info.empty()) {
+			return res;
+		}
+		res.info = info.front();
+		res.call_buses = image.Get<BusIdx>(Section::RoutingCallBuses);
+		res.up_offsets = image.Get<uint32_t>(Section::RoutingUpOffsets);
+		res.up_edges = image.Get<HierarchyEdge>(Section::RoutingUpEdges);
+		res.down_offsets = image.Get<uint32_t>(Section::RoutingDownOffsets);
+		res.down_edges = image.Get<HierarchyEdge>(Section::RoutingDownEdges);
+		return res;
+	}
+
+	std::vector<char> PackRoadDistances(Span<RoadDistance> values) {
+		std::vector<char> res(values.size() * sizeof(RoadDistance), '\0');
+		for (size_t i = 0; i < values.size(); ++i) {
+			char* dst = res.data() + i * sizeof(RoadDistance);
+			std::memcpy(dst + offsetof(RoadDistance, distance), &values[i].distance, sizeof(values[i].distance));
+			std::memcpy(dst + offsetof(RoadDistance, is_reverse), &values[i].is_reverse, sizeof(values[i].is_reverse));
+		}
+		return res;
+	}
+}
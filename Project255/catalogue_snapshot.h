@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "domain.h"
+
+// Binary snapshot of a finalized TransportCatalogue.
+//
+// Layout: a Header, a table of SectionCount SectionEntry records indexed by Section, then the
+// section payloads. Every payload starts at a multiple of SECTION_ALIGNMENT from the beginning of
+// the file, so a page-aligned mapping of the file can be queried in place, name indexes included.
+// Each section carries its own checksum and the header checksum covers the section table. Integers
+// are stored in native byte order; the header records it, and files from a machine with another
+// order are rejected.
+namespace snapshot {
+
+	constexpr char MAGIC[8] = { 'T', 'C', 'S', 'N', 'A', 'P', '\0', '\0' };
+	constexpr uint32_t VERSION = 7u;
+	constexpr uint32_t BYTE_ORDER_MARK = 0x01020304u;
+	constexpr size_t SECTION_ALIGNMENT = 32u;
+
+	enum class Section : uint32_t {
+		StopNameChars,
+		StopNameOffsets,
+		StopNameIndex,
+		BusNameChars,
+		BusNameOffsets,
+		BusNameIndex,
+		RouteOffsets,
+		RouteStops,
+		RouteCircle,
+		StopBusOffsets,
+		StopBuses,
+		RoadDistanceKeys,
+		RoadDistanceValues,
+		StopLat,
+		StopLng,
+		StopSinLat,
+		StopCosLat,
+		RouteStats,
+		StopBounds,
+		GridCellOffsets,
+		GridStops,
+		StopGrid,
+		RoutingInfo,
+		RoutingCallBuses,
+		RoutingUpOffsets,
+		RoutingUpEdges,
+		RoutingDownOffsets,
+		RoutingDownEdges,
+		RouteSumOffsets,
+		RouteDistanceSums,
+		RouteLengthSums,
+		StopBusBits,
+		TransferKeys,
+		TransferValues,
+		TransferStops,
+		SectionCount
+	};
+
+	constexpr size_t SECTION_COUNT = static_cast<size_t>(Section::SectionCount);
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order;
+		uint32_t section_count;
+		uint32_t reserved;
+		uint64_t file_size;
+		uint64_t checksum;
+	};
+
+	struct SectionEntry {
+		uint64_t offset;
+		uint64_t size;
+		uint64_t checksum;
+	};
+
+	// Structure checks the header, the section table and that section sizes agree, in O(1).
+	// Full also verifies every section checksum and every stored offset and index, in O(file size).
+	enum class Verification {
+		Structure,
+		Full
+	};
+
+	class FormatError : public std::runtime_error {
+	public:
+		using runtime_error::runtime_error;
+	};
+
+	uint64_t Checksum(const void* data, size_t size);
+
+	// Collects section payloads by reference and writes them out in one pass.
+	// The referenced memory must stay alive until Save() returns.
+	class Writer {
+	public:
+		Writer();
+
+		void Add(Section section, const void* data, size_t size);
+		template<typename T>
+		void Add(Section section, Span<T> v) {
+			Add(section, v.data(), v.size() * sizeof(T));
+		}
+
+		void Save(const std::string& path) const;
+
+	private:
+		struct Payload {
+			const void* data;
+			size_t size;
+		};
+		std::vector<Payload> _payloads;
+	};
+
+	// Validated, non-owning view of a snapshot image held in memory (read from disk or mapped).
+	// The constructor checks the header and section bounds, plus every section checksum with
+	// Verification::Full, and throws FormatError.
+	class Image {
+	public:
+		Image(const char* data, size_t size, Verification verification);
+
+		template<typename T>
+		Span<T> Get(Section section) const {
+			const SectionEntry& entry = _sections[static_cast<size_t>(section)];
+			if (entry.size % sizeof(T) != 0u) {
+				throw FormatError("Snapshot section has a size that does not match its element type"s);
+			}
+			return Span<T>(reinterpret_cast<const T*>(_data + entry.offset), static_cast<size_t>(entry.size / sizeof(T)));
+		}
+
+	private:
+		const char* _data;
+		SectionEntry _sections[SECTION_COUNT];
+	};
+
+	std::vector<char> ReadFile(const std::string& path);
+
+	// Checks that the sections of image describe a consistent catalogue: array sizes always, and with
+	// Verification::Full also every offset, index slot and stop/bus id, so that no query on the image
+	// can read out of bounds or probe forever. Structure trusts the contents of a file written by
+	// SaveSnapshot(). Throws FormatError.
+	void CheckLayout(const Image& image, Verification verification);
+
+	StringPoolRef StopNames(const Image& image);
+	StringPoolRef BusNames(const Image& image);
+	CatalogueView MakeView(const Image& image);
+	// Empty when the snapshot was saved without a routing hierarchy.
+	RoutingHierarchyView MakeRoutingHierarchy(const Image& image);
+
+	// RoadDistance has padding bytes; they are zeroed here so that equal catalogues give equal files.
+	std::vector<char> PackRoadDistances(Span<RoadDistance> values);
+}
@@ -0,0 +1,141 @@
+#include "catalogue_store.h"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+CatalogueStore::Reader::Reader(const CatalogueStore* store, size_t slot, uint64_t epoch, const Version* version)
+	: _store(store), _slot(slot), _epoch(epoch), _version(version) {}
+
+CatalogueStore::Reader::Reader(Reader&& other) noexcept
+	: _store(other._store), _slot(other._slot), _epoch(other._epoch), _version(other._version) {
+	other._store = nullptr;
+}
+
+CatalogueStore::Reader::~Reader() {
+	if (_store) {
+		_store->release(_slot, _epoch);
+	}
+}
+
+const TransportCatalogue& CatalogueStore::Reader::catalogue() const {
+	return *_version->catalogue;
+}
+
+uint64_t CatalogueStore::Reader::version() const {
+	return _version->number;
+}
+
+CatalogueStore::CatalogueStore(std::unique_ptr<TransportCatalogue> catalogue)
+	: _current(nullptr), _version(1u), _epoch(1u), _has_retired(false) {
+	if (!catalogue || !catalogue->isFinalized()) {
+		throw std::logic_error("CatalogueStore needs a finalized catalogue"s);
+	}
+	_owned = std::make_unique<Version>(Version{ std::move(catalogue), 1u });
+	_current.store(_owned.get());
+}
+
+CatalogueStore::~CatalogueStore() = default;
+
+CatalogueStore::Reader CatalogueStore::acquire() const {
+	// The epoch is pinned before the pointer is loaded, and publish() swaps the pointer before it
+	// scans the slots, so either the scan sees this pin or this load sees the new version.
+	const uint64_t epoch = _epoch.load();
+	const size_t first = std::hash<std::thread::id>{}(std::this_thread::get_id()) % READER_SLOTS;
+	for (size_t attempt = 0; attempt < READER_SLOTS; ++attempt) {
+		const size_t slot = (first + attempt) % READER_SLOTS;
+		uint64_t idle = IDLE;
+		if (_slots[slot].epoch.compare_exchange_strong(idle, epoch)) {
+			return Reader(this, slot, epoch, _current.load());
+		}
+	}
+	// Every slot is pinned. The pointer is loaded under the overflow lock, which reclaim() takes to
+	// scan the list, so the same argument holds.
+	std::lock_guard<std::mutex> lock(_overflow_mutex);
+	++_overflow[epoch];
+	return Reader(this, OVERFLOW_SLOT, epoch, _current.load());
+}
+
+uint64_t CatalogueStore::version() const {
+	return _version.load();
+}
+
+void CatalogueStore::publish(std::unique_ptr<TransportCatalogue> catalogue) {
+	if (!catalogue || !catalogue->isFinalized()) {
+		throw std::logic_error("Only a finalized catalogue can be published"s);
+	}
+	{
+		std::lock_guard<std::mutex> lock(_publish_mutex);
+		auto next = std::make_unique<Version>(Version{ std::move(catalogue), _owned->number + 1u });
+		_current.store(next.get());
+		_version.store(next->number);
+		const uint64_t retire_epoch = _epoch.fetch_add(1u) + 1u;
+		std::lock_guard<std::mutex> retired_lock(_retired_mutex);
+		_retired.push_back({ std::move(_owned), retire_epoch });
+		_has_retired.store(true);
+		_owned = std::move(next);
+	}
+	reclaim(true);
+}
+
+void CatalogueStore::reload(const std::string& path, snapshot::Verification verification) {
+	auto catalogue = std::make_unique<TransportCatalogue>();
+	catalogue->MapSnapshot(path, verification);
+	publish(std::move(catalogue));
+}
+
+void CatalogueStore::reclaim() const {
+	reclaim(true);
+}
+
+void CatalogueStore::release(size_t slot, uint64_t epoch) const {
+	if (slot == OVERFLOW_SLOT) {
+		std::lock_guard<std::mutex> lock(_overflow_mutex);
+		auto it = _overflow.find(epoch);
+		if (--it->second == 0u) {
+			_overflow.erase(it);
+		}
+	}
+	else {
+		_slots[slot].epoch.store(IDLE);
+	}
+	if (_has_retired.load()) {
+		reclaim(false);
+	}
+}
+
+void CatalogueStore::reclaim(bool wait) const {
+	// Unmapping or freeing a catalogue can take a while, so expired versions are destroyed on return,
+	// outside the lock.
+	std::vector<Retired> expired;
+	{
+		std::unique_lock<std::mutex> lock(_retired_mutex, std::defer_lock);
+		if (wait) {
+			lock.lock();
+		}
+		else if (!lock.try_lock()) {
+			return;
+		}
+		uint64_t oldest = std::numeric_limits<uint64_t>::max();
+		for (const ReaderSlot& slot : _slots) {
+			const uint64_t epoch = slot.epoch.load();
+			if (epoch != IDLE) {
+				oldest = std::min(oldest, epoch);
+			}
+		}
+		{
+			std::lock_guard<std::mutex> overflow_lock(_overflow_mutex);
+			if (!_overflow.empty()) {
+				oldest = std::min(oldest, _overflow.begin()->first);
+			}
+		}
+		// Readers pinned at the retirement epoch or later loaded the pointer after the swap.
+		auto expired_begin = std::partition(_retired.begin(), _retired.end(), [oldest](const Retired& r) { return r.epoch > oldest; });
+		std::move(expired_begin, _retired.end(), std::back_inserter(expired));
+		_retired.erase(expired_begin, _retired.end());
+		_has_retired.store(!_retired.empty());
+	}
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "transport_catalogue.h"
+
+// Current version of a catalogue in a long-running process. New versions are swapped in while
+// readers are in flight: read-copy-update with epoch-based reclamation of the old versions.
+//
+// A reader pins the current epoch in one of READER_SLOTS slots before it loads the version pointer
+// and keeps that version until it is released, whatever gets published meanwhile. publish() swaps
+// the pointer, advances the epoch and retires the previous version, which is destroyed once no
+// reader is pinned at an epoch older than its retirement. Readers take no lock while a slot is free;
+// beyond READER_SLOTS concurrent readers the others pin their epoch in an overflow list under a mutex.
+class CatalogueStore {
+	struct Version {
+		std::unique_ptr<TransportCatalogue> catalogue;
+		uint64_t number;
+	};
+
+public:
+	// Pins one catalogue version for as long as it lives.
+	class Reader {
+	public:
+		Reader(Reader&& other) noexcept;
+		Reader(const Reader&) = delete;
+		Reader& operator=(const Reader&) = delete;
+		Reader& operator=(Reader&&) = delete;
+		~Reader();
+
+		const TransportCatalogue& catalogue() const;
+		uint64_t version() const;
+
+	private:
+		friend class CatalogueStore;
+		Reader(const CatalogueStore* store, size_t slot, uint64_t epoch, const Version* version);
+
+		const CatalogueStore* _store;
+		// OVERFLOW_SLOT for a reader pinned in the overflow list.
+		size_t _slot;
+		uint64_t _epoch;
+		const Version* _version;
+	};
+
+	// The catalogue must be finalized or mapped; it becomes version 1.
+	explicit CatalogueStore(std::unique_ptr<TransportCatalogue> catalogue);
+	CatalogueStore(const CatalogueStore&) = delete;
+	CatalogueStore& operator=(const CatalogueStore&) = delete;
+	// Every Reader must have been released.
+	~CatalogueStore();
+
+	Reader acquire() const;
+	uint64_t version() const;
+
+	// Makes catalogue the current version for every later acquire().
+	void publish(std::unique_ptr<TransportCatalogue> catalogue);
+	// Maps the snapshot at path and publishes it. On any error the current version stays in place.
+	void reload(const std::string& path, snapshot::Verification verification = snapshot::Verification::Structure);
+
+	// Destroys the retired versions no reader can see any more. Also done by publish() and, without
+	// waiting for the lock, by the release of a reader.
+	void reclaim() const;
+
+private:
+	static constexpr size_t READER_SLOTS = 64u;
+	static constexpr size_t OVERFLOW_SLOT = READER_SLOTS;
+	static constexpr uint64_t IDLE = 0u;
+
+	struct alignas(64) ReaderSlot {
+		std::atomic<uint64_t> epoch{ IDLE };
+	};
+
+	struct Retired {
+		std::unique_ptr<Version> version;
+		uint64_t epoch;
+	};
+
+	void release(size_t slot, uint64_t epoch) const;
+	void reclaim(bool wait) const;
+
+	std::atomic<const Version*> _current;
+	// Number of the version _current points to, readable without pinning it.
+	std::atomic<uint64_t> _version;
+	std::atomic<uint64_t> _epoch;
+	mutable std::array<ReaderSlot, READER_SLOTS> _slots;
+	// Readers pinned past the slots, counted by epoch.
+	mutable std::mutex _overflow_mutex;
+	mutable std::map<uint64_t, size_t> _overflow;
+
+	// Serializes publishers; _owned is the version _current points to.
+	std::mutex _publish_mutex;
+	std::unique_ptr<Version> _owned;
+
+	mutable std::mutex _retired_mutex;
+	mutable std::vector<Retired> _retired;
+	mutable std::atomic<bool> _has_retired;
+};
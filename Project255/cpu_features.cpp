@@ -0,0 +1,43 @@
+#include "cpu_features.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CPU_HAS_X86_64
+#if defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+#ifdef CPU_HAS_X86_64
+	bool DetectAvx2() {
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+}
+
+bool CpuHasAvx2() {
+#ifdef CPU_HAS_X86_64
+	static const bool has_avx2 = DetectAvx2();
+	return has_avx2;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// Whether the CPU running the process supports AVX2, for the kernels picked at run time. Checked
+// once; always false on other architectures.
+bool CpuHasAvx2();
@@ -1,4 +1,5 @@
 #include "domain.h"
+#include "bit_set.h"
 
 /*
  *       /,     
@@ -59,6 +60,116 @@ void ftrim(std::string& s) {
 	mtrim(s);
 }
 
+GeoBounds GeoBounds::Empty() {
+	return { std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() };
+}
+
+void GeoBounds::extend(RouteStopLocation location) {
+	min_lat = std::min(min_lat, location.lat);
+	min_lng = std::min(min_lng, location.lng);
+	max_lat = std::max(max_lat, location.lat);
+	max_lng = std::max(max_lng, location.lng);
+}
+
+bool GeoBounds::touches(RouteStopLocation location) const {
+	return location.lat == min_lat || location.lat == max_lat || location.lng == min_lng || location.lng == max_lng;
+}
+
+uint32_t StopGrid::row(double lat) const {
+	const double r = std::floor((lat - min_lat) / cell_lat);
+	return r <= 0.0 ? 0u : static_cast<uint32_t>(std::min(r, static_cast<double>(rows - 1u)));
+}
+
+uint32_t StopGrid::col(double lng) const {
+	const double c = std::floor((lng - min_lng) / cell_lng);
+	return c <= 0.0 ? 0u : static_cast<uint32_t>(std::min(c, static_cast<double>(cols - 1u)));
+}
+
+uint32_t StopGrid::cell(uint32_t row, uint32_t col) const {
+	return row * cols + col;
+}
+
+size_t RideSegmentCount(RouteRef route) {
+	const size_t n = route.stops.size();
+	if (n == 0u) {
+		return 0u;
+	}
+	return route.isRouteCircle ? n : 2u * (n - 1u);
+}
+
+size_t CatalogueView::busCount() const {
+	return route_circle.size();
+}
+
+size_t CatalogueView::stopCount() const {
+	return stop_lat.size();
+}
+
+RouteRef CatalogueView::route(BusIdx bus) const {
+	return { route_stops.subspan(route_offsets[bus], route_offsets[bus + 1] - route_offsets[bus]), route_circle[bus] != 0 };
+}
+
+Span<BusIdx> CatalogueView::stopBuses(StopIdx stop) const {
+	return stop_buses.subspan(stop_bus_offsets[stop], stop_bus_offsets[stop + 1] - stop_bus_offsets[stop]);
+}
+
+RouteStopLocation CatalogueView::stopLocation(StopIdx stop) const {
+	return { stop_lat[stop], stop_lng[stop] };
+}
+
+const RoadDistance* CatalogueView::roadDistance(StopIdx from, StopIdx to) const {
+	const size_t slot = RoadDistanceTable::Find(road_distance_keys.data(), road_distance_keys.size(), RoadDistanceTable::MakeKey(from, to));
+	return slot == RoadDistanceTable::NPOS ? nullptr : &road_distance_values[slot];
+}
+
+const uint64_t* CatalogueView::stopBusBits(StopIdx stop) const {
+	return stop_bus_bits.data() + stop * BitSetWords(busCount());
+}
+
+Span<StopIdx> CatalogueView::transferStops(BusIdx first, BusIdx second) const {
+	const size_t slot = TransferTable::Find(transfer_keys.data(), transfer_keys.size(), TransferTable::MakeKey(std::min(first, second), std::max(first, second)));
+	if (slot == TransferTable::NPOS) {
+		return {};
+	}
+	return transfer_stops.subspan(transfer_values[slot].offset, transfer_values[slot].count);
+}
+
+Span<double> CatalogueView::routeDistanceSums(BusIdx bus) const {
+	return route_distance_sums.subspan(route_sum_offsets[bus], route_sum_offsets[bus + 1] - route_sum_offsets[bus]);
+}
+
+Span<double> CatalogueView::routeLengthSums(BusIdx bus) const {
+	return route_length_sums.subspan(route_sum_offsets[bus], route_sum_offsets[bus + 1] - route_sum_offsets[bus]);
+}
+
+CatalogueView CatalogueLayout::view() const {
+	CatalogueView res;
+	res.route_offsets = route_offsets;
+	res.route_stops = route_stops;
+	res.route_circle = route_circle;
+	res.stop_bus_offsets = stop_bus_offsets;
+	res.stop_buses = stop_buses;
+	res.road_distance_keys = road_distances.keys();
+	res.road_distance_values = road_distances.values();
+	res.stop_lat = stop_lat;
+	res.stop_lng = stop_lng;
+	res.stop_sin_lat = stop_sin_lat;
+	res.stop_cos_lat = stop_cos_lat;
+	res.route_stats = route_stats;
+	res.route_sum_offsets = route_sum_offsets;
+	res.route_distance_sums = route_distance_sums;
+	res.route_length_sums = route_length_sums;
+	res.stop_bounds = stop_bounds;
+	res.grid_cell_offsets = grid_cell_offsets;
+	res.grid_stops = grid_stops;
+	res.stop_grid = stop_grid;
+	res.stop_bus_bits = stop_bus_bits;
+	res.transfer_keys = transfers.keys();
+	res.transfer_values = transfers.values();
+	res.transfer_stops = transfer_stops;
+	return res;
+}
+
 InputRequestType UserInputData::getRequestType() const {
 	return _request_type;
 }
@@ -129,6 +240,46 @@ std::string& StopStatInputData::getStopName() {
 	return _stop_name;
 }
 
+BusSectionStatInputData::BusSectionStatInputData(int id, BusID bus_id, std::string from, std::string to) : UserStatData(id), _bus_id(std::move(bus_id)), _from(std::move(from)), _to(std::move(to)) {
+	setRequestType(StatRequestType::BusSection);
+}
+
+BusID& BusSectionStatInputData::getBusID() {
+	return _bus_id;
+}
+
+std::string& BusSectionStatInputData::getFrom() {
+	return _from;
+}
+
+std::string& BusSectionStatInputData::getTo() {
+	return _to;
+}
+
+SharedBusesStatInputData::SharedBusesStatInputData(int id, std::string first_stop, std::string second_stop) : UserStatData(id), _first_stop(std::move(first_stop)), _second_stop(std::move(second_stop)) {
+	setRequestType(StatRequestType::SharedBuses);
+}
+
+std::string& SharedBusesStatInputData::getFirstStop() {
+	return _first_stop;
+}
+
+std::string& SharedBusesStatInputData::getSecondStop() {
+	return _second_stop;
+}
+
+TransferStopsStatInputData::TransferStopsStatInputData(int id, BusID first_bus, BusID second_bus) : UserStatData(id), _first_bus(std::move(first_bus)), _second_bus(std::move(second_bus)) {
+	setRequestType(StatRequestType::TransferStops);
+}
+
+BusID& TransferStopsStatInputData::getFirstBus() {
+	return _first_bus;
+}
+
+BusID& TransferStopsStatInputData::getSecondBus() {
+	return _second_bus;
+}
+
 const std::string EvtData_Before_Start_Processing::sk_EventName = "EvtData_Before_Start_Processing";
 
 EvtData_Before_Start_Processing::EvtData_Before_Start_Processing() : m_out(std::cout) {}
@@ -424,3 +575,118 @@ MapStatInputData::MapStatInputData(int id, const RenderSettings& settings) : Use
 const RenderSettings& MapStatInputData::getRenderSettings() {
 	return _settings;
 }
+
+NearestStopsStatInputData::NearestStopsStatInputData(int id, Coordinates point, int count) : UserStatData(id), _point(point), _count(count) {
+	setRequestType(StatRequestType::NearestStops);
+}
+
+Coordinates NearestStopsStatInputData::getPoint() {
+	return _point;
+}
+
+int NearestStopsStatInputData::getCount() {
+	return _count;
+}
+
+AreaStatInputData::AreaStatInputData(int id, GeoBounds area) : UserStatData(id), _area(area) {
+	setRequestType(StatRequestType::Area);
+}
+
+const GeoBounds& AreaStatInputData::getArea() {
+	return _area;
+}
+
+RouteStatInputData::RouteStatInputData(int id, std::string from, std::string to, const RoutingSettings& settings) : UserStatData(id), _from(std::move(from)), _to(std::move(to)), _settings(settings) {
+	setRequestType(StatRequestType::Route);
+}
+
+std::string& RouteStatInputData::getFrom() {
+	return _from;
+}
+
+std::string& RouteStatInputData::getTo() {
+	return _to;
+}
+
+const RoutingSettings& RouteStatInputData::getRoutingSettings() {
+	return _settings;
+}
+
+JourneysStatInputData::JourneysStatInputData(int id, std::string from, std::string to, uint32_t max_transfers, const RoutingSettings& settings) : UserStatData(id), _from(std::move(from)), _to(std::move(to)), _max_transfers(max_transfers), _settings(settings) {
+	setRequestType(StatRequestType::Journeys);
+}
+
+std::string& JourneysStatInputData::getFrom() {
+	return _from;
+}
+
+std::string& JourneysStatInputData::getTo() {
+	return _to;
+}
+
+uint32_t JourneysStatInputData::getMaxTransfers() {
+	return _max_transfers;
+}
+
+const RoutingSettings& JourneysStatInputData::getRoutingSettings() {
+	return _settings;
+}
+
+MatrixStatInputData::MatrixStatInputData(int id, std::vector<std::string> origins, std::vector<std::string> destinations, const RoutingSettings& settings) : UserStatData(id), _origins(std::move(origins)), _destinations(std::move(destinations)), _settings(settings) {
+	setRequestType(StatRequestType::Matrix);
+}
+
+std::vector<std::string>& MatrixStatInputData::getOrigins() {
+	return _origins;
+}
+
+std::vector<std::string>& MatrixStatInputData::getDestinations() {
+	return _destinations;
+}
+
+const RoutingSettings& MatrixStatInputData::getRoutingSettings() {
+	return _settings;
+}
+
+IsochroneStatInputData::IsochroneStatInputData(int id, std::string from, IsochroneLimit limit_type, double limit, const RoutingSettings& settings, std::optional<RenderSettings> render_settings) : UserStatData(id), _from(std::move(from)), _limit_type(limit_type), _limit(limit), _settings(settings), _render_settings(std::move(render_settings)) {
+	setRequestType(StatRequestType::Isochrone);
+}
+
+std::string& IsochroneStatInputData::getFrom() {
+	return _from;
+}
+
+IsochroneLimit IsochroneStatInputData::getLimitType() {
+	return _limit_type;
+}
+
+double IsochroneStatInputData::getLimit() {
+	return _limit;
+}
+
+const RoutingSettings& IsochroneStatInputData::getRoutingSettings() {
+	return _settings;
+}
+
+const std::optional<RenderSettings>& IsochroneStatInputData::getRenderSettings() {
+	return _render_settings;
+}
+
+bool RoutingHierarchyView::empty() const {
+	return up_offsets.empty();
+}
+
+size_t RoutingHierarchyView::vertexCount() const {
+	return info.stop_count + call_buses.size();
+}
+
+RoutingHierarchyView RoutingHierarchy::view() const {
+	RoutingHierarchyView res;
+	res.info = info;
+	res.call_buses = call_buses;
+	res.up_offsets = up_offsets;
+	res.up_edges = up_edges;
+	res.down_offsets = down_offsets;
+	res.down_edges = down_edges;
+	return res;
+}
@@ -9,15 +9,21 @@
 #include <algorithm>
 #include <iterator>
 #include <limits>
+#include <cmath>
 #include <unordered_set>
 #include <unordered_map>
 #include <functional>
 #include <type_traits>
 #include <sstream>
 #include <set>
+#include <memory_resource>
 #include <iostream>
+#include <new>
+#include <optional>
 
 #include "svg.h"
+#include "pair_key_table.h"
+#include "string_pool.h"
 
 /*
  *       /,      (domain)
@@ -223,28 +229,274 @@ using RouteStopLocation = Coordinates;
 using dist = int;
 using Distances = std::unordered_map<std::string, dist>;
 
+using StopIdx = uint32_t;
+using BusIdx = uint32_t;
+using StopDistance = std::pair<StopIdx, dist>;
+
 struct LocalBuses {
 	RouteStopLocation location;
-	std::set<BusID> buses;
-	Distances distances;
+	std::pmr::vector<BusIdx> buses; // unordered and may repeat; sorted by name and deduplicated by Finalize()
+	std::pmr::vector<StopDistance> distances;
 };
 
 struct Route {
-	std::vector<RouteStopName> stops;
+	std::pmr::vector<StopIdx> stops;
 	bool isRouteCircle;
 };
 
+template<typename T>
+class Span {
+public:
+	using value_type = T;
+	using const_iterator = const T*;
+	using const_reverse_iterator = std::reverse_iterator<const T*>;
+
+	Span() : _data(nullptr), _size(0u) {}
+	Span(const T* data, size_t size) : _data(data), _size(size) {}
+	template<typename Allocator>
+	Span(const std::vector<T, Allocator>& v) : _data(v.data()), _size(v.size()) {}
+
+	const T* data() const { return _data; }
+	size_t size() const { return _size; }
+	bool empty() const { return _size == 0u; }
+
+	const T& operator[](size_t idx) const { return _data[idx]; }
+	const T& front() const { return _data[0]; }
+	const T& back() const { return _data[_size - 1u]; }
+
+	const_iterator begin() const { return _data; }
+	const_iterator end() const { return _data + _size; }
+	const_iterator cbegin() const { return _data; }
+	const_iterator cend() const { return _data + _size; }
+	const_reverse_iterator crbegin() const { return const_reverse_iterator(cend()); }
+	const_reverse_iterator crend() const { return const_reverse_iterator(cbegin()); }
+
+	Span subspan(size_t offset, size_t count) const { return Span(_data + offset, count); }
+
+private:
+	const T* _data;
+	size_t _size;
+};
+
+template<typename T, size_t Alignment>
+struct AlignedAllocator {
+	using value_type = T;
+
+	template<typename U>
+	struct rebind {
+		using other = AlignedAllocator<U, Alignment>;
+	};
+
+	AlignedAllocator() noexcept = default;
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{ Alignment }));
+	}
+
+	void deallocate(T* p, size_t) noexcept {
+		::operator delete(p, std::align_val_t{ Alignment });
+	}
+};
+
+template<typename T, typename U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) noexcept {
+	return true;
+}
+
+template<typename T, typename U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) noexcept {
+	return false;
+}
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T, 32>>;
+
+struct RouteRef {
+	Span<StopIdx> stops;
+	bool isRouteCircle;
+};
+
+// Segments of one ride of a bus back to its first stop: round a circle route, out and back otherwise.
+size_t RideSegmentCount(RouteRef route);
+
 struct Trace {
 	BusID bus_num;
-	const Route* route;
+	RouteRef route;
 };
 
-using RouteStops = std::unordered_map<RouteStopName, LocalBuses>;
-using Buses = std::unordered_map<BusID, Route>;
+// Non-owning views of parsed base requests handed to TransportCatalogue::Load().
+struct StopLoadData {
+	std::string_view name;
+	Coordinates coordinates;
+	const Distances* distances;
+};
+
+struct BusLoadData {
+	std::string_view name;
+	const std::vector<RouteStopName>* stops;
+	bool is_circle;
+};
+
+using RouteStops = std::pmr::vector<LocalBuses>;
+using Buses = std::pmr::vector<Route>;
+
+struct RoadDistance {
+	dist distance;
+	bool is_reverse;
+};
+
+using RoadDistanceTable = PairKeyTable<RoadDistance>;
+
+// Stops two buses have in common, as a range of CatalogueLayout::transfer_stops.
+struct TransferRange {
+	uint32_t offset;
+	uint32_t count;
+};
+
+using TransferTable = PairKeyTable<TransferRange>;
+
+struct RouteStats {
+	double length;
+	double distance;
+	double curvature;
+	uint32_t stop_count;
+	uint32_t unique_stop_count;
+};
+
+// Part of a ride between two stops of a bus; see TransportCatalogue::findRouteSection().
+struct RouteSection {
+	double length;
+	double distance;
+	uint32_t stop_count;
+};
+
+// Extent of the stops served by at least one bus; the map projection is fitted to it.
+struct GeoBounds {
+	double min_lat;
+	double min_lng;
+	double max_lat;
+	double max_lng;
+
+	static GeoBounds Empty();
+	void extend(RouteStopLocation location);
+	// Whether location lies on the border, i.e. the bounds may shrink once it is gone.
+	bool touches(RouteStopLocation location) const;
+};
+
+// Uniform latitude/longitude grid over the stops. Row r covers latitudes from min_lat + r * cell_lat,
+// column c longitudes from min_lng + c * cell_lng; positions outside fall into the border cells.
+struct StopGrid {
+	double min_lat;
+	double min_lng;
+	double cell_lat;
+	double cell_lng;
+	uint32_t rows;
+	uint32_t cols;
+
+	uint32_t row(double lat) const;
+	uint32_t col(double lng) const;
+	uint32_t cell(uint32_t row, uint32_t col) const;
+};
+
+// Read-only view of the layout compiled by TransportCatalogue::Finalize(). It points either into a
+// CatalogueLayout or into the sections of a mapped snapshot.
+// Row i of every *_offsets array spans [offsets[i], offsets[i + 1]).
+struct CatalogueView {
+	Span<uint32_t> route_offsets;
+	Span<StopIdx> route_stops;
+	Span<uint8_t> route_circle;
+
+	Span<uint32_t> stop_bus_offsets;
+	Span<BusIdx> stop_buses;
+
+	// Slot arrays of a RoadDistanceTable.
+	Span<uint64_t> road_distance_keys;
+	Span<RoadDistance> road_distance_values;
+
+	Span<double> stop_lat;
+	Span<double> stop_lng;
+	Span<double> stop_sin_lat;
+	Span<double> stop_cos_lat;
+
+	Span<RouteStats> route_stats;
+
+	Span<uint32_t> route_sum_offsets;
+	Span<double> route_distance_sums;
+	Span<double> route_length_sums;
+
+	GeoBounds stop_bounds;
+
+	// Stops of every grid cell, cell by cell; erased stops are left out.
+	Span<uint32_t> grid_cell_offsets;
+	Span<StopIdx> grid_stops;
+	StopGrid stop_grid;
+
+	Span<uint64_t> stop_bus_bits;
+	// Slot arrays of a TransferTable.
+	Span<uint64_t> transfer_keys;
+	Span<TransferRange> transfer_values;
+	Span<StopIdx> transfer_stops;
+
+	size_t busCount() const;
+	size_t stopCount() const;
+	RouteRef route(BusIdx bus) const;
+	Span<BusIdx> stopBuses(StopIdx stop) const;
+	RouteStopLocation stopLocation(StopIdx stop) const;
+	const RoadDistance* roadDistance(StopIdx from, StopIdx to) const;
+	Span<double> routeDistanceSums(BusIdx bus) const;
+	Span<double> routeLengthSums(BusIdx bus) const;
+	const uint64_t* stopBusBits(StopIdx stop) const;
+	Span<StopIdx> transferStops(BusIdx first, BusIdx second) const;
+};
+
+// Storage of the CSR layout compiled by TransportCatalogue::Finalize().
+struct CatalogueLayout {
+	std::vector<uint32_t> route_offsets;
+	std::vector<StopIdx> route_stops;
+	std::vector<uint8_t> route_circle;
+
+	std::vector<uint32_t> stop_bus_offsets;
+	std::vector<BusIdx> stop_buses;
+
+	RoadDistanceTable road_distances;
+
+	AlignedVector<double> stop_lat;
+	AlignedVector<double> stop_lng;
+	AlignedVector<double> stop_sin_lat;
+	AlignedVector<double> stop_cos_lat;
+
+	std::vector<RouteStats> route_stats;
+
+	// Road distance and geographic length ridden by a bus from its first stop up to each position of
+	// a ride, RideSegmentCount() + 1 of them: the stops of the route, then the first stop again for a
+	// circle route or the stops back to it for the others. Empty for a route without stops.
+	std::vector<uint32_t> route_sum_offsets;
+	std::vector<double> route_distance_sums;
+	std::vector<double> route_length_sums;
+
+	GeoBounds stop_bounds = GeoBounds::Empty();
+
+	std::vector<uint32_t> grid_cell_offsets;
+	std::vector<StopIdx> grid_stops;
+	StopGrid stop_grid{};
+
+	// Bus bit set of every stop, bit b set when bus b calls at it, in rows of BitSetWords(bus count)
+	// words.
+	AlignedVector<uint64_t> stop_bus_bits;
+	// Stops every pair of buses with any in common shares, keyed first <= second by bus id and listed
+	// in transfer_stops by stop id. A bus paired with itself gets all of its stops.
+	TransferTable transfers;
+	std::vector<StopIdx> transfer_stops;
+
+	CatalogueView view() const;
+};
 
 struct LocalBusFullRef {
-	const Buses* all_buses;
-	const RouteStops* route_stops;
+	const CatalogueView* layout;
+	StringPoolRef bus_names;
+	StringPoolRef stop_names;
 };
 
 struct LocalBusFull {
@@ -309,7 +561,16 @@ public:
 enum class StatRequestType {
 	BusStat,
 	StopStat,
-	Map
+	Map,
+	NearestStops,
+	Area,
+	Route,
+	Journeys,
+	Matrix,
+	Isochrone,
+	BusSection,
+	SharedBuses,
+	TransferStops
 };
 
 class UserStatData {
@@ -343,6 +604,41 @@ private:
 	std::string _stop_name;
 };
 
+class BusSectionStatInputData : public UserStatData {
+public:
+	BusSectionStatInputData(int id, BusID bus_id, std::string from, std::string to);
+	BusID& getBusID();
+	std::string& getFrom();
+	std::string& getTo();
+
+private:
+	BusID _bus_id;
+	std::string _from;
+	std::string _to;
+};
+
+class SharedBusesStatInputData : public UserStatData {
+public:
+	SharedBusesStatInputData(int id, std::string first_stop, std::string second_stop);
+	std::string& getFirstStop();
+	std::string& getSecondStop();
+
+private:
+	std::string _first_stop;
+	std::string _second_stop;
+};
+
+class TransferStopsStatInputData : public UserStatData {
+public:
+	TransferStopsStatInputData(int id, BusID first_bus, BusID second_bus);
+	BusID& getFirstBus();
+	BusID& getSecondBus();
+
+private:
+	BusID _first_bus;
+	BusID _second_bus;
+};
+
 struct RenderSettings {
 	double width;
 	double height;
@@ -371,6 +667,140 @@ private:
 	RenderSettings _settings;
 };
 
+class NearestStopsStatInputData : public UserStatData {
+public:
+	NearestStopsStatInputData(int id, Coordinates point, int count);
+	Coordinates getPoint();
+	int getCount();
+
+private:
+	Coordinates _point;
+	int _count;
+};
+
+class AreaStatInputData : public UserStatData {
+public:
+	AreaStatInputData(int id, GeoBounds area);
+	const GeoBounds& getArea();
+
+private:
+	GeoBounds _area;
+};
+
+struct RoutingSettings {
+	double bus_wait_time; // minutes spent at a stop before each boarding
+	double bus_velocity;  // km/h
+};
+
+// Edge of a contraction hierarchy. middle is the vertex a shortcut bypasses, NO_VERTEX for an edge of
+// the routing graph itself.
+struct HierarchyEdge {
+	static constexpr uint32_t NO_VERTEX = std::numeric_limits<uint32_t>::max();
+
+	uint32_t to;
+	uint32_t middle;
+	double weight;
+};
+
+struct RoutingHierarchyInfo {
+	RoutingSettings settings; // the edge weights depend on them
+	uint32_t stop_count;
+	uint32_t reserved;
+};
+
+// Read-only view of a contraction hierarchy of the TransportRouter graph: vertices [0, stop_count) are
+// the stops, stop_count + i the call of bus call_buses[i]. It points either into a RoutingHierarchy or
+// into the sections of a mapped snapshot, and is empty when no hierarchy was built.
+// Row v of up_edges lists the edges from v to higher-ranked vertices; row v of down_edges the edges
+// into v from higher-ranked vertices, to naming their source.
+struct RoutingHierarchyView {
+	RoutingHierarchyInfo info{};
+	Span<BusIdx> call_buses;
+	Span<uint32_t> up_offsets;
+	Span<HierarchyEdge> up_edges;
+	Span<uint32_t> down_offsets;
+	Span<HierarchyEdge> down_edges;
+
+	bool empty() const;
+	size_t vertexCount() const;
+};
+
+struct RoutingHierarchy {
+	RoutingHierarchyInfo info{};
+	std::vector<BusIdx> call_buses;
+	std::vector<uint32_t> up_offsets;
+	std::vector<HierarchyEdge> up_edges;
+	std::vector<uint32_t> down_offsets;
+	std::vector<HierarchyEdge> down_edges;
+
+	RoutingHierarchyView view() const;
+};
+
+class RouteStatInputData : public UserStatData {
+public:
+	RouteStatInputData(int id, std::string from, std::string to, const RoutingSettings& settings);
+	std::string& getFrom();
+	std::string& getTo();
+	const RoutingSettings& getRoutingSettings();
+
+private:
+	std::string _from;
+	std::string _to;
+	RoutingSettings _settings;
+};
+
+class JourneysStatInputData : public UserStatData {
+public:
+	JourneysStatInputData(int id, std::string from, std::string to, uint32_t max_transfers, const RoutingSettings& settings);
+	std::string& getFrom();
+	std::string& getTo();
+	uint32_t getMaxTransfers();
+	const RoutingSettings& getRoutingSettings();
+
+private:
+	std::string _from;
+	std::string _to;
+	uint32_t _max_transfers;
+	RoutingSettings _settings;
+};
+
+class MatrixStatInputData : public UserStatData {
+public:
+	MatrixStatInputData(int id, std::vector<std::string> origins, std::vector<std::string> destinations, const RoutingSettings& settings);
+	std::vector<std::string>& getOrigins();
+	std::vector<std::string>& getDestinations();
+	const RoutingSettings& getRoutingSettings();
+
+private:
+	std::vector<std::string> _origins;
+	std::vector<std::string> _destinations;
+	RoutingSettings _settings;
+};
+
+// What bounds an isochrone: minutes of travel, or meters ridden.
+enum class IsochroneLimit {
+	Time,
+	Distance
+};
+
+class IsochroneStatInputData : public UserStatData {
+public:
+	IsochroneStatInputData(int id, std::string from, IsochroneLimit limit_type, double limit, const RoutingSettings& settings, std::optional<RenderSettings> render_settings);
+	std::string& getFrom();
+	IsochroneLimit getLimitType();
+	double getLimit();
+	const RoutingSettings& getRoutingSettings();
+	// Set when the reachable stops are to be drawn over the map.
+	const std::optional<RenderSettings>& getRenderSettings();
+
+private:
+	std::string _from;
+	IsochroneLimit _limit_type;
+	double _limit;
+	RoutingSettings _settings;
+	std::optional<RenderSettings> _render_settings;
+};
+
 class StatReader {
 public:
 	virtual std::vector<std::unique_ptr<UserStatData>> getUserStat(std::istream& in) = 0;
@@ -1,22 +1,234 @@
 #define _USE_MATH_DEFINES
 #include "geo.h"
+#include "cpu_features.h"
 
+#include <algorithm>
 #include <cmath>
+#include <utility>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define GEO_HAS_X86_64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define GEO_TARGET_AVX2
+#else
+#define GEO_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+	constexpr double dr = 3.14159265358979323846 / 180.0;
+	constexpr double equatorial_radius = 6378.1370;
+	constexpr double distance_center_to_pole = 6356.7523;
+	constexpr double R = ((2.0 * equatorial_radius + distance_center_to_pole) / 3.0) * 1000.0; //WGS84
+
+	inline double SegmentDistance(double sf1, double cf1, double lng1, double sf2, double cf2, double lng2) {
+		using namespace std;
+		double dl = abs(lng1 - lng2) * dr;
+		double sdl = sin(dl);
+		double cdl = cos(dl);
+		return (atan((sqrt((cf2 * sdl) * (cf2 * sdl) + (cf1 * sf2 - sf1 * cf2 * cdl) * (cf1 * sf2 - sf1 * cf2 * cdl))) / (sf1 * sf2 + cf1 * cf2 * cdl))) * R;
+	}
+
+	void ComputeSegmentDistancesScalar(const GeoPointsRef& points, const uint32_t* path, size_t path_size, double* distances) {
+		for (size_t i = 0; i + 1 < path_size; ++i) {
+			uint32_t from = path[i];
+			uint32_t to = path[i + 1];
+			distances[i] = SegmentDistance(points.sin_lat[from], points.cos_lat[from], points.lng[from], points.sin_lat[to], points.cos_lat[to], points.lng[to]);
+		}
+	}
+
+#ifdef GEO_HAS_X86_64
+	// sin/cos and atan below follow the Cephes double precision kernels: Cody-Waite reduction by pi/4
+	// with minimax polynomials for sin/cos, and a three-range rational approximation for atan.
+
+	GEO_TARGET_AVX2 inline __m256d Polynomial(__m256d x, const double* coefs, int count) {
+		__m256d res = _mm256_set1_pd(coefs[0]);
+		for (int i = 1; i < count; ++i) {
+			res = _mm256_add_pd(_mm256_mul_pd(res, x), _mm256_set1_pd(coefs[i]));
+		}
+		return res;
+	}
+
+	GEO_TARGET_AVX2 inline void SinCosAvx2(__m256d x, __m256d& s, __m256d& c) {
+		static constexpr double sin_coefs[] = {
+			1.58962301576546568060E-10, -2.50507477628578072866E-8, 2.75573136213857245213E-6,
+			-1.98412698295895385996E-4, 8.33333333332211858878E-3, -1.66666666666666307295E-1
+		};
+		static constexpr double cos_coefs[] = {
+			-1.13585365213876817300E-11, 2.08757008419747316778E-9, -2.75573141792967388112E-7,
+			2.48015872888517045348E-5, -1.38888888888730564116E-3, 4.16666666666665929218E-2
+		};
+		const __m256d sign_bit = _mm256_set1_pd(-0.0);
+
+		__m128i j = _mm256_cvttpd_epi32(_mm256_mul_pd(x, _mm256_set1_pd(4.0 / M_PI)));
+		j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+		__m256d y = _mm256_cvtepi32_pd(j);
+
+		__m256d z = _mm256_sub_pd(x, _mm256_mul_pd(y, _mm256_set1_pd(7.85398125648498535156E-1)));
+		z = _mm256_sub_pd(z, _mm256_mul_pd(y, _mm256_set1_pd(3.77489470793079817668E-8)));
+		z = _mm256_sub_pd(z, _mm256_mul_pd(y, _mm256_set1_pd(2.69515142907905952645E-15)));
+		__m256d zz = _mm256_mul_pd(z, z);
+
+		__m256d ps = _mm256_add_pd(z, _mm256_mul_pd(_mm256_mul_pd(z, zz), Polynomial(zz, sin_coefs, 6)));
+		__m256d pc = _mm256_add_pd(
+			_mm256_sub_pd(_mm256_set1_pd(1.0), _mm256_mul_pd(zz, _mm256_set1_pd(0.5))),
+			_mm256_mul_pd(_mm256_mul_pd(zz, zz), Polynomial(zz, cos_coefs, 6))
+		);
+
+		__m128i zero = _mm_setzero_si128();
+		__m256d swap = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmpgt_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), zero)));
+		__m256d sin_neg = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmpgt_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), zero)));
+		__m256d cos_neg = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmpgt_epi32(_mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), zero)));
+
+		s = _mm256_xor_pd(_mm256_blendv_pd(ps, pc, swap), _mm256_and_pd(sin_neg, sign_bit));
+		c = _mm256_xor_pd(_mm256_blendv_pd(pc, ps, swap), _mm256_and_pd(cos_neg, sign_bit));
+	}
+
+	GEO_TARGET_AVX2 inline __m256d AtanAvx2(__m256d x) {
+		static constexpr double p_coefs[] = {
+			-8.750608600031904122785E-1, -1.615753718733365076637E1, -7.500855792314704667340E1,
+			-1.228866684490136173410E2, -6.485021904942025371773E1
+		};
+		static constexpr double q_coefs[] = {
+			1.0, 2.485846490142306297962E1, 1.650270098316988542046E2, 4.328810604912902668951E2,
+			4.853903996359136964868E2, 1.945506571482613964425E2
+		};
+		static constexpr double more_bits = 6.123233995736765886130E-17;
+		const __m256d sign_bit = _mm256_set1_pd(-0.0);
+		const __m256d one = _mm256_set1_pd(1.0);
+
+		__m256d sign = _mm256_and_pd(x, sign_bit);
+		x = _mm256_andnot_pd(sign_bit, x);
+
+		__m256d big = _mm256_cmp_pd(x, _mm256_set1_pd(2.41421356237309504880), _CMP_GT_OQ);
+		__m256d mid = _mm256_andnot_pd(big, _mm256_cmp_pd(x, _mm256_set1_pd(0.66), _CMP_GT_OQ));
+
+		__m256d xr = _mm256_blendv_pd(x, _mm256_div_pd(_mm256_sub_pd(x, one), _mm256_add_pd(x, one)), mid);
+		xr = _mm256_blendv_pd(xr, _mm256_div_pd(_mm256_set1_pd(-1.0), x), big);
+		__m256d y = _mm256_blendv_pd(_mm256_setzero_pd(), _mm256_set1_pd(M_PI_4), mid);
+		y = _mm256_blendv_pd(y, _mm256_set1_pd(M_PI_2), big);
+		__m256d more = _mm256_blendv_pd(_mm256_setzero_pd(), _mm256_set1_pd(0.5 * more_bits), mid);
+		more = _mm256_blendv_pd(more, _mm256_set1_pd(more_bits), big);
+
+		__m256d z = _mm256_mul_pd(xr, xr);
+		z = _mm256_div_pd(_mm256_mul_pd(z, Polynomial(z, p_coefs, 5)), Polynomial(z, q_coefs, 6));
+		z = _mm256_add_pd(_mm256_mul_pd(xr, z), xr);
+		y = _mm256_add_pd(y, _mm256_add_pd(z, more));
+		return _mm256_xor_pd(y, sign);
+	}
+
+	// Gathers base[index] for four indices. The masked form with an explicit zero source does the same
+	// loads as _mm256_i32gather_pd, which GCC reports as reading an uninitialized source under -Wall.
+	GEO_TARGET_AVX2 inline __m256d GatherAvx2(const double* base, __m128i index) {
+		return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, index, _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8);
+	}
+
+	GEO_TARGET_AVX2 void ComputeSegmentDistancesAvx2(const GeoPointsRef& points, const uint32_t* path, size_t path_size, double* distances) {
+		const __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+		size_t i = 0;
+		for (; i + 4 < path_size; i += 4) {
+			__m128i from = _mm_loadu_si128(reinterpret_cast<const __m128i*>(path + i));
+			__m128i to = _mm_loadu_si128(reinterpret_cast<const __m128i*>(path + i + 1));
+
+			__m256d sf1 = GatherAvx2(points.sin_lat, from);
+			__m256d cf1 = GatherAvx2(points.cos_lat, from);
+			__m256d sf2 = GatherAvx2(points.sin_lat, to);
+			__m256d cf2 = GatherAvx2(points.cos_lat, to);
+			__m256d dl = _mm256_sub_pd(GatherAvx2(points.lng, from), GatherAvx2(points.lng, to));
+			dl = _mm256_mul_pd(_mm256_and_pd(dl, abs_mask), _mm256_set1_pd(dr));
+
+			__m256d sdl;
+			__m256d cdl;
+			SinCosAvx2(dl, sdl, cdl);
+
+			__m256d a = _mm256_mul_pd(cf2, sdl);
+			__m256d b = _mm256_sub_pd(_mm256_mul_pd(cf1, sf2), _mm256_mul_pd(_mm256_mul_pd(sf1, cf2), cdl));
+			__m256d num = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(a, a), _mm256_mul_pd(b, b)));
+			__m256d den = _mm256_add_pd(_mm256_mul_pd(sf1, sf2), _mm256_mul_pd(_mm256_mul_pd(cf1, cf2), cdl));
+			_mm256_storeu_pd(distances + i, _mm256_mul_pd(AtanAvx2(_mm256_div_pd(num, den)), _mm256_set1_pd(R)));
+		}
+		ComputeSegmentDistancesScalar(points, path + i, path_size - i, distances + i);
+	}
+#endif
+
+	using SegmentDistancesFn = void (*)(const GeoPointsRef&, const uint32_t*, size_t, double*);
+
+	SegmentDistancesFn SelectSegmentDistances() {
+#ifdef GEO_HAS_X86_64
+		if (CpuHasAvx2()) {
+			return ComputeSegmentDistancesAvx2;
+		}
+#endif
+		return ComputeSegmentDistancesScalar;
+	}
+}
 
 double ComputeDistance(Coordinates from, Coordinates to) {
 	using namespace std;
-	static constexpr double dr = 3.14159265358979323846 / 180.0;
-	static constexpr double equatorial_radius = 6378.1370;
-	static constexpr double distance_center_to_pole = 6356.7523;
-	static constexpr double R = ((2.0 * equatorial_radius + distance_center_to_pole) / 3.0) * 1000.0; //WGS84
 	double f1 = from.lat * dr;
 	double sf1 = sin(f1);
 	double cf1 = cos(f1);
 	double f2 = to.lat * dr;
 	double sf2 = sin(f2);
 	double cf2 = cos(f2);
-	double dl = abs(from.lng - to.lng) * dr;
-	double sdl = sin(dl);
-	double cdl = cos(dl);
-	return (atan((sqrt((cf2 * sdl) * (cf2 * sdl) + (cf1 * sf2 - sf1 * cf2 * cdl) * (cf1 * sf2 - sf1 * cf2 * cdl))) / (sf1 * sf2 + cf1 * cf2 * cdl))) * R;
-}
\ No newline at end of file
+	return SegmentDistance(sf1, cf1, from.lng, sf2, cf2, to.lng);
+}
+
+double ComputeDistance(const GeoPointsRef& points, uint32_t from, uint32_t to) {
+	return SegmentDistance(points.sin_lat[from], points.cos_lat[from], points.lng[from], points.sin_lat[to], points.cos_lat[to], points.lng[to]);
+}
+
+double ComputeDistance(Coordinates from, const GeoPointsRef& points, uint32_t to) {
+	double f1 = from.lat * dr;
+	return SegmentDistance(std::sin(f1), std::cos(f1), from.lng, points.sin_lat[to], points.cos_lat[to], points.lng[to]);
+}
+
+double ComputeDistanceLowerBound(double lat_gap, double lng_gap, double max_abs_lat) {
+	using namespace std;
+	// Haversine: sin^2(d / 2R) >= cos(lat1) * cos(lat2) * sin^2(dlng / 2), and d >= R * dlat.
+	double by_lat = lat_gap * dr * R;
+	double by_lng = 2.0 * asin(cos(max_abs_lat * dr) * sin(min(lng_gap, 180.0) * dr / 2.0)) * R;
+	return min(by_lat, by_lng);
+}
+
+uint64_t ComputeHilbertIndex(Coordinates point, const GeoBounds& extent) {
+	constexpr uint32_t side = 1u << 16;
+	auto cell = [](double x, double min, double max) {
+		if (!(max > min)) {
+			return 0u;
+		}
+		double scaled = (x - min) / (max - min) * side;
+		return static_cast<uint32_t>(std::clamp(scaled, 0.0, static_cast<double>(side - 1u)));
+	};
+	uint32_t x = cell(point.lng, extent.min_lng, extent.max_lng);
+	uint32_t y = cell(point.lat, extent.min_lat, extent.max_lat);
+	uint64_t index = 0;
+	for (uint32_t s = side / 2u; s > 0u; s /= 2u) {
+		uint32_t rx = (x & s) ? 1u : 0u;
+		uint32_t ry = (y & s) ? 1u : 0u;
+		index += uint64_t{ s } * s * ((3u * rx) ^ ry);
+		// Rotates the quadrant so that the curve stays continuous across its border.
+		if (ry == 0u) {
+			if (rx == 1u) {
+				x = side - 1u - x;
+				y = side - 1u - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return index;
+}
+
+void ComputeLatitudeTrigonometry(const double* lat, size_t count, double* sin_lat, double* cos_lat) {
+	for (size_t i = 0; i < count; ++i) {
+		double f = lat[i] * dr;
+		sin_lat[i] = std::sin(f);
+		cos_lat[i] = std::cos(f);
+	}
+}
+
+void ComputeSegmentDistances(const GeoPointsRef& points, const uint32_t* path, size_t path_size, double* distances) {
+	static const SegmentDistancesFn segment_distances = SelectSegmentDistances();
+	segment_distances(points, path, path_size, distances);
+}
@@ -5,4 +5,28 @@
 
 #include "domain.h"
 
-double ComputeDistance(Coordinates from, Coordinates to);
\ No newline at end of file
+// Stop positions stored as separate arrays; sin_lat/cos_lat cache the trigonometry of every latitude
+// so that a segment only needs sin/cos of its longitude delta.
+struct GeoPointsRef {
+	const double* lng;
+	const double* sin_lat;
+	const double* cos_lat;
+};
+
+double ComputeDistance(Coordinates from, Coordinates to);
+double ComputeDistance(const GeoPointsRef& points, uint32_t from, uint32_t to);
+double ComputeDistance(Coordinates from, const GeoPointsRef& points, uint32_t to);
+
+// Lower bound of the distance between two points within max_abs_lat degrees of the equator whose
+// latitudes differ by at least lat_gap degrees or whose longitudes differ by at least lng_gap degrees.
+double ComputeDistanceLowerBound(double lat_gap, double lng_gap, double max_abs_lat);
+
+// Position of point along a Hilbert curve of order 16 laid over extent: points close on the curve are
+// close on the ground. Points outside extent are clamped to its border.
+uint64_t ComputeHilbertIndex(Coordinates point, const GeoBounds& extent);
+
+void ComputeLatitudeTrigonometry(const double* lat, size_t count, double* sin_lat, double* cos_lat);
+
+// distances[i] receives the distance between points path[i] and path[i + 1] for every i < path_size - 1.
+// Uses an AVX2 kernel when the CPU supports it and a scalar loop otherwise.
+void ComputeSegmentDistances(const GeoPointsRef& points, const uint32_t* path, size_t path_size, double* distances);
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "json_reader.h"
 
+#include <limits>
+
 /*
  *          JSON,
  *              JSON
@@ -237,7 +239,15 @@ std::vector<std::unique_ptr<UserStatData>> StatReaderText::getUserStat(std::istr
 		if (command == "Bus") {
 			BusID bid;
 			in >> bid;
-			res.push_back(std::make_unique<BusStatInputData>(m_ct++, std::move(bid)));
+			// "Bus X from A to B" asks for the section of the route between two stops.
+			std::string section = getStopName(in);
+			const size_t to_pos = section.find(" to "s);
+			if (section.rfind("from "s, 0) == 0 && to_pos != std::string::npos) {
+				res.push_back(std::make_unique<BusSectionStatInputData>(m_ct++, std::move(bid), section.substr(5, to_pos - 5), section.substr(to_pos + 4)));
+			}
+			else {
+				res.push_back(std::make_unique<BusStatInputData>(m_ct++, std::move(bid)));
+			}
 		}
 		if (command == "Stop") {
 			std::string stopName = getStopName(in);
@@ -276,6 +286,36 @@ std::vector<std::unique_ptr<UserStatData>> StatReaderJson::getUserStat(const jso
 				)
 			);
 		}
+		else if (command == "BusSection") {
+			res.push_back(
+				std::make_unique<BusSectionStatInputData>(
+					rq.at("id").AsInt(),
+					rq.at("name").AsString(),
+					rq.at("from").AsString(),
+					rq.at("to").AsString()
+				)
+			);
+		}
+		else if (command == "SharedBuses") {
+			const json::Array& stops = rq.at("stops").AsArray();
+			res.push_back(
+				std::make_unique<SharedBusesStatInputData>(
+					rq.at("id").AsInt(),
+					stops.at(0).AsString(),
+					stops.at(1).AsString()
+				)
+			);
+		}
+		else if (command == "TransferStops") {
+			const json::Array& buses = rq.at("buses").AsArray();
+			res.push_back(
+				std::make_unique<TransferStopsStatInputData>(
+					rq.at("id").AsInt(),
+					buses.at(0).AsString(),
+					buses.at(1).AsString()
+				)
+			);
+		}
 		else if (command == "Map") {
 			res.push_back(
 				std::make_unique<MapStatInputData>(
@@ -284,11 +324,97 @@ std::vector<std::unique_ptr<UserStatData>> StatReaderJson::getUserStat(const jso
 				)
 			);
 		}
+		else if (command == "NearestStops") {
+			res.push_back(
+				std::make_unique<NearestStopsStatInputData>(
+					rq.at("id").AsInt(),
+					Coordinates{ rq.at("latitude").AsDouble(), rq.at("longitude").AsDouble() },
+					rq.at("count").AsInt()
+				)
+			);
+		}
+		else if (command == "Area") {
+			res.push_back(
+				std::make_unique<AreaStatInputData>(
+					rq.at("id").AsInt(),
+					GeoBounds{
+						rq.at("min_latitude").AsDouble(),
+						rq.at("min_longitude").AsDouble(),
+						rq.at("max_latitude").AsDouble(),
+						rq.at("max_longitude").AsDouble()
+					}
+				)
+			);
+		}
+		else if (command == "Route") {
+			res.push_back(
+				std::make_unique<RouteStatInputData>(
+					rq.at("id").AsInt(),
+					rq.at("from").AsString(),
+					rq.at("to").AsString(),
+					getRoutingSettings(doc)
+				)
+			);
+		}
+		else if (command == "Journeys") {
+			res.push_back(
+				std::make_unique<JourneysStatInputData>(
+					rq.at("id").AsInt(),
+					rq.at("from").AsString(),
+					rq.at("to").AsString(),
+					rq.count("max_transfers") > 0u ? static_cast<uint32_t>(rq.at("max_transfers").AsInt()) : std::numeric_limits<uint32_t>::max(),
+					getRoutingSettings(doc)
+				)
+			);
+		}
+		else if (command == "Matrix") {
+			auto names = [](const json::Node& node) {
+				std::vector<std::string> res;
+				res.reserve(node.AsArray().size());
+				for (const json::Node& name : node.AsArray()) {
+					res.push_back(name.AsString());
+				}
+				return res;
+			};
+			res.push_back(
+				std::make_unique<MatrixStatInputData>(
+					rq.at("id").AsInt(),
+					names(rq.at("origins")),
+					names(rq.at("destinations")),
+					getRoutingSettings(doc)
+				)
+			);
+		}
+		else if (command == "Isochrone") {
+			const bool by_distance = rq.count("max_distance") > 0u;
+			const bool render = rq.count("render") > 0u && rq.at("render").AsBool();
+			// Stops within a distance do not depend on the velocity they are ridden at, so a document
+			// without routing settings still answers distance isochrones.
+			RoutingSettings settings{ 0.0, 40.0 };
+			if (!by_distance || doc.GetRoot().AsDict().count("routing_settings") > 0u) {
+				settings = getRoutingSettings(doc);
+			}
+			res.push_back(
+				std::make_unique<IsochroneStatInputData>(
+					rq.at("id").AsInt(),
+					rq.at("from").AsString(),
+					by_distance ? IsochroneLimit::Distance : IsochroneLimit::Time,
+					by_distance ? rq.at("max_distance").AsDouble() : rq.at("max_time").AsDouble(),
+					settings,
+					render ? std::optional<RenderSettings>(getRenderSettings(doc)) : std::nullopt
+				)
+			);
+		}
 	}
 
 	return res;
 }
 
+RoutingSettings StatReaderJson::getRoutingSettings(const json::Document& doc) {
+	const json::Dict& routing_settings = doc.GetRoot().AsDict().at("routing_settings").AsDict();
+	return { routing_settings.at("bus_wait_time").AsDouble(), routing_settings.at("bus_velocity").AsDouble() };
+}
+
 RenderSettings StatReaderJson::getRenderSettings(const json::Document& doc) {
 	RenderSettings res;
 	const json::Dict& render_settings = doc.GetRoot().AsDict().at("render_settings").AsDict();
@@ -333,6 +459,10 @@ RenderSettings IOReaderJson::getRenderSettings(const json::Document& doc) {
 	return m_statReaderJson.getRenderSettings(doc);
 }
 
+RoutingSettings IOReaderJson::getRoutingSettings(const json::Document& doc) {
+	return m_statReaderJson.getRoutingSettings(doc);
+}
+
 svg::Color StatReaderJson::getColor(const json::Node& node) {
 	if (node.IsString()) {
 		return node.AsString();
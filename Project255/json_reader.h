@@ -89,6 +89,7 @@ public:
 	std::vector<std::unique_ptr<UserStatData>> getUserStat(std::istream& in) override;
 	std::vector<std::unique_ptr<UserStatData>> getUserStat(const json::Document& doc);
 	RenderSettings getRenderSettings(const json::Document& doc);
+	RoutingSettings getRoutingSettings(const json::Document& doc);
 private:
 	svg::Color getColor(const json::Node& node);
 };
@@ -101,6 +102,7 @@ public:
 	std::vector<std::unique_ptr<UserStatData>> getUserStat(std::istream& in) override;
 	std::vector<std::unique_ptr<UserStatData>> getUserStat(const json::Document& doc);
 	RenderSettings getRenderSettings(const json::Document& doc);
+	RoutingSettings getRoutingSettings(const json::Document& doc);
 private:
 	InputReaderJson m_inputReaderJson;
 	StatReaderJson m_statReaderJson;
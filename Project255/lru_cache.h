@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+// Bounded cache of values derived from a catalogue, evicting the least recently used entry once full.
+// Every entry belongs to the catalogue generation it was computed for: a query for a newer generation
+// drops them all, and a query for an older one, e.g. from a reader still holding a previous version,
+// neither hits nor stores anything. The cache may be used from several threads.
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+public:
+	struct Stats {
+		uint64_t hits;
+		uint64_t misses;
+		size_t size;
+	};
+
+	explicit LruCache(size_t capacity) : _capacity(capacity) {}
+	LruCache(const LruCache&) = delete;
+	LruCache& operator=(const LruCache&) = delete;
+
+	size_t capacity() const { return _capacity; }
+
+	std::optional<Value> find(uint64_t generation, const Key& key) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!adopt(generation)) {
+			++_misses;
+			return std::nullopt;
+		}
+		auto it = _index.find(key);
+		if (it == _index.end()) {
+			++_misses;
+			return std::nullopt;
+		}
+		++_hits;
+		_entries.splice(_entries.begin(), _entries, it->second);
+		return it->second->second;
+	}
+
+	void insert(uint64_t generation, const Key& key, Value value) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_capacity == 0u || !adopt(generation)) {
+			return;
+		}
+		auto it = _index.find(key);
+		if (it != _index.end()) {
+			it->second->second = std::move(value);
+			_entries.splice(_entries.begin(), _entries, it->second);
+			return;
+		}
+		if (_entries.size() == _capacity) {
+			_index.erase(_entries.back().first);
+			_entries.pop_back();
+		}
+		_entries.emplace_front(key, std::move(value));
+		_index.emplace(key, _entries.begin());
+	}
+
+	// The cached value, or compute() stored and returned. compute() runs without the lock, so misses on
+	// several threads proceed in parallel; the same key missed twice at once is computed twice.
+	template<typename ComputeFn>
+	Value getOrCompute(uint64_t generation, const Key& key, ComputeFn&& compute) {
+		if (std::optional<Value> value = find(generation, key)) {
+			return std::move(*value);
+		}
+		Value value = compute();
+		insert(generation, key, value);
+		return value;
+	}
+
+	Stats stats() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return { _hits, _misses, _entries.size() };
+	}
+
+	void clear() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_index.clear();
+		_entries.clear();
+	}
+
+private:
+	using Entries = std::list<std::pair<Key, Value>>;
+
+	// Whether entries of generation may be served and stored, dropping those of an older one.
+	bool adopt(uint64_t generation) {
+		if (generation < _generation) {
+			return false;
+		}
+		if (generation > _generation) {
+			_index.clear();
+			_entries.clear();
+			_generation = generation;
+		}
+		return true;
+	}
+
+	const size_t _capacity;
+	mutable std::mutex _mutex;
+	uint64_t _generation = 0;
+	uint64_t _hits = 0;
+	uint64_t _misses = 0;
+	Entries _entries;
+	std::unordered_map<Key, typename Entries::iterator, Hash> _index;
+};
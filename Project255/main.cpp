@@ -1,25 +1,86 @@
+#include <filesystem>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <memory>
 
 #include "domain.h"
+#include "catalogue_store.h"
 #include "transport_catalogue.h"
 #include "geo.h"
 #include "json.h"
 #include "json_reader.h"
 #include "request_handler.h"
+#include "stop_order_benchmark.h"
+#include "transport_router.h"
 
-int main() {
+// Usage: Project255 [make_base <snapshot> | process_requests <snapshot> | serve <snapshot> | benchmark_stop_order [<stop count>]]
+// make_base builds the catalogue from base_requests and saves it as a snapshot, with the routing
+// hierarchy for routing_settings when the input has them;
+// process_requests maps the snapshot instead of loading base_requests and answers stat_requests;
+// serve keeps the mapped snapshot in a CatalogueStore and answers every document that follows on
+// stdin, republishing the snapshot before a document once make_base has replaced it;
+// benchmark_stop_order reads nothing and compares stop orders on a synthetic city.
+int main(int argc, char* argv[]) {
 	using namespace std::literals;
+
+	if (argc >= 2 && std::string_view(argv[1]) == "benchmark_stop_order"sv) {
+		RunStopOrderBenchmark(argc >= 3 ? std::stoul(argv[2]) : 100000u, std::cout);
+		return 0;
+	}
+
+	const std::string_view mode = argc >= 3 ? std::string_view(argv[1]) : std::string_view();
+
+	if (mode == "serve"sv) {
+		const std::string path = argv[2];
+		auto catalogue = std::make_unique<TransportCatalogue>();
+		catalogue->MapSnapshot(path);
+		CatalogueStore store(std::move(catalogue));
+		std::filesystem::file_time_type loaded = std::filesystem::last_write_time(path);
+
+		std::unique_ptr<IOReaderJson> ioReaderJson = IOReaderFactory::Create<IOReaderJson>();
+		StatDataProcessor proc = StatDataProcessorFactory::Create(StreamType::JSON);
+		while (std::cin >> std::ws && std::cin.peek() != std::char_traits<char>::eof()) {
+			const json::Document doc = json::Load(std::cin);
+			// make_base renames a complete snapshot into place, so a changed time means a new version.
+			// A snapshot that fails to load is reported once and the current version keeps serving.
+			std::error_code error;
+			const std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, error);
+			if (!error && modified != loaded) {
+				loaded = modified;
+				try {
+					store.reload(path);
+				}
+				catch (const std::exception& e) {
+					std::cerr << "Cannot reload "s << path << ": "s << e.what() << std::endl;
+				}
+			}
+			proc.Process(store, ioReaderJson->getUserStat(doc), std::cout);
+			std::cout << std::endl;
+		}
+		return 0;
+	}
     
 	TransportCatalogue tc;
 	const json::Document doc = json::Load(std::cin);
 	
 	std::unique_ptr<IOReaderJson> ioReaderJson = IOReaderFactory::Create<IOReaderJson>();
-	std::vector<std::unique_ptr<UserInputData>> inputData = ioReaderJson->getUserInput(doc);
-	InputDataProcessor::Process(tc, std::move(inputData));
+	if (mode == "process_requests"sv) {
+		tc.MapSnapshot(argv[2]);
+	}
+	else {
+		std::vector<std::unique_ptr<UserInputData>> inputData = ioReaderJson->getUserInput(doc);
+		InputDataProcessor::Process(tc, std::move(inputData));
+	}
+	if (mode == "make_base"sv) {
+		if (doc.GetRoot().AsDict().count("routing_settings"s) > 0u) {
+			tc.setRoutingHierarchy(TransportRouter::Contract(tc, ioReaderJson->getRoutingSettings(doc)));
+		}
+		tc.SaveSnapshot(argv[2]);
+		return 0;
+	}
 	
 	std::vector<std::unique_ptr<UserStatData>> statData = ioReaderJson->getUserStat(doc);
 	StatDataProcessor proc = StatDataProcessorFactory::Create(StreamType::JSON);
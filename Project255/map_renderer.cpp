@@ -1,5 +1,6 @@
 #include "map_renderer.h"
 
+#include <algorithm>
 #include <limits>
 
 /*
@@ -69,31 +70,29 @@ void RoutePictureRef::Draw(svg::ObjectContainer& container) const {
     size_t color_ct = 0;
     size_t colors = m_render_settings.color_palette.size();
     std::unordered_map<BusID, std::vector<std::pair<svg::Point, std::string>>> points;
-    double min_x = std::numeric_limits<double>::max();
-    double min_y = std::numeric_limits<double>::max();
-    double max_x = std::numeric_limits<double>::min();
-    double max_y = std::numeric_limits<double>::min();
-    for (auto const& [bid, route_info] : *m_routes_info.all_buses) {
+    const GeoBounds& bounds = m_routes_info.layout->stop_bounds;
+    double min_x = bounds.min_lat;
+    double min_y = bounds.min_lng;
+    double max_x = bounds.max_lat;
+    double max_y = bounds.max_lng;
+    for (BusIdx bus = 0; bus < m_routes_info.layout->busCount(); ++bus) {
+        const BusID bid(m_routes_info.bus_names[bus]);
+        RouteRef route_info = m_routes_info.layout->route(bus);
         if (route_info.stops.size() == 0) { continue; }
         std::vector<std::pair<svg::Point, std::string>> lp;
         size_t sz = route_info.stops.size();
         lp.reserve(sz);
         for (auto it = route_info.stops.cbegin(); it != route_info.stops.cend(); ++it) {
-            const RouteStopName& stop_name = *it;
-            const LocalBuses& lb = (*m_routes_info.route_stops).at(stop_name);
-            double x = lb.location.lat;
-            double y = lb.location.lng;
-            if (x < min_x) { min_x = x; }
-            if (y < min_y) { min_y = y; }
-            if (x > max_x) { max_x = x; }
-            if (y > max_y) { max_y = y; }
+            const RouteStopName stop_name(m_routes_info.stop_names[*it]);
+            RouteStopLocation location = m_routes_info.layout->stopLocation(*it);
+            double x = location.lat;
+            double y = location.lng;
             lp.push_back({ { x, y }, stop_name });
         }
         if (route_info.isRouteCircle) {
-            const RouteStopName& stop_name = route_info.stops[0];
-            const LocalBuses& lb = (*m_routes_info.route_stops).at(stop_name);
-            double x = lb.location.lat;
-            double y = lb.location.lng;
+            RouteStopLocation location = m_routes_info.layout->stopLocation(route_info.stops[0]);
+            double x = location.lat;
+            double y = location.lng;
             lp.push_back({ { x, y }, ""s });
         }
         points.insert({ bid, std::move(lp) });
@@ -212,37 +211,40 @@ void RoutePictureRef::Draw(svg::ObjectContainer& container) const {
             container.Add(textBus);
         }
     }
+    DrawReachableStops(container);
+}
+
+void RoutePictureRef::SetReachableStops(std::vector<std::pair<StopIdx, double>> stops, double limit) {
+    m_reachable_stops = std::move(stops);
+    m_reachable_limit = limit;
 }
 
 void RoutePictureRef::DrawRouteLineStrip(svg::ObjectContainer& container) const {
     size_t color_ct = 0;
     size_t colors = m_render_settings.color_palette.size();
     std::unordered_map<BusID, std::vector<svg::Point>> points;
-    double min_x = std::numeric_limits<double>::max();
-    double min_y = std::numeric_limits<double>::max();
-    double max_x = std::numeric_limits<double>::min();
-    double max_y = std::numeric_limits<double>::min();
-    for (auto const& [bid, route_info] : *m_routes_info.all_buses) {
+    const GeoBounds& bounds = m_routes_info.layout->stop_bounds;
+    double min_x = bounds.min_lat;
+    double min_y = bounds.min_lng;
+    double max_x = bounds.max_lat;
+    double max_y = bounds.max_lng;
+    for (BusIdx bus = 0; bus < m_routes_info.layout->busCount(); ++bus) {
+        const BusID bid(m_routes_info.bus_names[bus]);
+        RouteRef route_info = m_routes_info.layout->route(bus);
         if (route_info.stops.size() == 0) { continue; }
         std::vector<svg::Point> lp;
         size_t sz = route_info.stops.size();
         lp.reserve(sz);
         for (auto it = route_info.stops.cbegin(); it != route_info.stops.cend(); ++it) {
-            const RouteStopName& stop_name = *it;
-            const LocalBuses& lb = (*m_routes_info.route_stops).at(stop_name);
-            double x = lb.location.lat;
-            double y = lb.location.lng;
-            if (x < min_x) { min_x = x; }
-            if (y < min_y) { min_y = y; }
-            if (x > max_x) { max_x = x; }
-            if (y > max_y) { max_y = y; }
+            RouteStopLocation location = m_routes_info.layout->stopLocation(*it);
+            double x = location.lat;
+            double y = location.lng;
             lp.push_back({ x, y });
         }
         if (route_info.isRouteCircle) {
-            const RouteStopName& stop_name = route_info.stops[0];
-            const LocalBuses& lb = (*m_routes_info.route_stops).at(stop_name);
-            double x = lb.location.lat;
-            double y = lb.location.lng;
+            RouteStopLocation location = m_routes_info.layout->stopLocation(route_info.stops[0]);
+            double x = location.lat;
+            double y = location.lng;
             lp.push_back({ x, y });
         }
         points.insert({ bid, std::move(lp) });
@@ -274,24 +276,23 @@ void RoutePictureRef::DrawRouteNames(svg::ObjectContainer& container) const {
     size_t color_ct = 0;
     size_t colors = m_render_settings.color_palette.size();
     std::unordered_map<BusID, std::vector<std::pair<svg::Point, std::string>>> points;
-    double min_x = std::numeric_limits<double>::max();
-    double min_y = std::numeric_limits<double>::max();
-    double max_x = std::numeric_limits<double>::min();
-    double max_y = std::numeric_limits<double>::min();
-    for (auto const& [bid, route_info] : *m_routes_info.all_buses) {
+    const GeoBounds& bounds = m_routes_info.layout->stop_bounds;
+    double min_x = bounds.min_lat;
+    double min_y = bounds.min_lng;
+    double max_x = bounds.max_lat;
+    double max_y = bounds.max_lng;
+    for (BusIdx bus = 0; bus < m_routes_info.layout->busCount(); ++bus) {
+        const BusID bid(m_routes_info.bus_names[bus]);
+        RouteRef route_info = m_routes_info.layout->route(bus);
         if (route_info.stops.size() == 0) { continue; }
         std::vector<std::pair<svg::Point, std::string>> lp;
         size_t sz = route_info.stops.size();
         lp.reserve(sz);
         for (auto it = route_info.stops.cbegin(); it != route_info.stops.cend(); ++it) {
-            const RouteStopName& stop_name = *it;
-            const LocalBuses& lb = (*m_routes_info.route_stops).at(stop_name);
-            double x = lb.location.lat;
-            double y = lb.location.lng;
-            if (x < min_x) { min_x = x; }
-            if (y < min_y) { min_y = y; }
-            if (x > max_x) { max_x = x; }
-            if (y > max_y) { max_y = y; }
+            const RouteStopName stop_name(m_routes_info.stop_names[*it]);
+            RouteStopLocation location = m_routes_info.layout->stopLocation(*it);
+            double x = location.lat;
+            double y = location.lng;
             lp.push_back({ { x, y }, stop_name });
         }
         points.insert({ bid, std::move(lp) });
@@ -322,3 +323,25 @@ void RoutePictureRef::DrawRouteNames(svg::ObjectContainer& container) const {
         }
     }
 }
+
+void RoutePictureRef::DrawReachableStops(svg::ObjectContainer& container) const {
+    const GeoBounds& bounds = m_routes_info.layout->stop_bounds;
+    double length_x = bounds.max_lat - bounds.min_lat;
+    double length_y = bounds.max_lng - bounds.min_lng;
+    double x_resolution = m_render_settings.height - m_render_settings.padding * 2.0;
+    double y_resolution = m_render_settings.width - m_render_settings.padding * 2.0;
+    // All stops on one parallel or meridian give a zero span; they are then drawn at the padding.
+    auto share_of = [](double offset, double length) { return length > 0.0 ? offset / length : 0.0; };
+    for (const auto& [stop, cost] : m_reachable_stops) {
+        RouteStopLocation location = m_routes_info.layout->stopLocation(stop);
+        double x = share_of(location.lat - bounds.min_lat, length_x) * x_resolution + m_render_settings.padding;
+        double y = share_of(location.lng - bounds.min_lng, length_y) * y_resolution + m_render_settings.padding;
+        double share = m_reachable_limit > 0.0 ? std::min(cost / m_reachable_limit, 1.0) : 0.0;
+        svg::Circle circle;
+        circle
+            .SetCenter({ x, y })
+            .SetRadius(m_render_settings.stop_radius * 2.0)
+            .SetFillColor(svg::Rgba(static_cast<uint8_t>(255.0 * share), static_cast<uint8_t>(255.0 * (1.0 - share)), 0, 0.5));
+        container.Add(circle);
+    }
+}
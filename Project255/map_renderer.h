@@ -28,10 +28,15 @@ class RoutePictureRef : public svg::Drawable {
 public:
     RoutePictureRef(const RenderSettings& settings, LocalBusFullRef info);
     void Draw(svg::ObjectContainer& container) const override;
+    // Overlays stops with their costs, shaded from green at no cost to red at limit.
+    void SetReachableStops(std::vector<std::pair<StopIdx, double>> stops, double limit);
 private:
     void DrawRouteLineStrip(svg::ObjectContainer& container) const;
     void DrawRouteNames(svg::ObjectContainer& container) const;
+    void DrawReachableStops(svg::ObjectContainer& container) const;
 
     const RenderSettings m_render_settings;
     LocalBusFullRef m_routes_info;
+    std::vector<std::pair<StopIdx, double>> m_reachable_stops;
+    double m_reachable_limit = 0.0;
 };
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) : _data(nullptr), _size(0u), _file(INVALID_HANDLE_VALUE), _mapping(nullptr) {
+	_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (_file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Cannot open file " + path);
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+		CloseHandle(_file);
+		throw std::runtime_error("Cannot map empty file " + path);
+	}
+	_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping == nullptr) {
+		CloseHandle(_file);
+		throw std::runtime_error("Cannot map file " + path);
+	}
+	_data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (_data == nullptr) {
+		CloseHandle(_mapping);
+		CloseHandle(_file);
+		throw std::runtime_error("Cannot map file " + path);
+	}
+	_size = static_cast<size_t>(size.QuadPart);
+}
+
+MappedFile::~MappedFile() {
+	UnmapViewOfFile(_data);
+	CloseHandle(_mapping);
+	CloseHandle(_file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) : _data(nullptr), _size(0u) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Cannot open file " + path);
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		throw std::runtime_error("Cannot map empty file " + path);
+	}
+	void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	// The mapping keeps its own reference to the file.
+	close(fd);
+	if (data == MAP_FAILED) {
+		throw std::runtime_error("Cannot map file " + path);
+	}
+	_data = static_cast<const char*>(data);
+	_size = static_cast<size_t>(st.st_size);
+}
+
+MappedFile::~MappedFile() {
+	munmap(const_cast<char*>(_data), _size);
+}
+
+#endif
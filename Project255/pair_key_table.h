@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+// Open-addressing hash table keyed by a pair of 32-bit ids packed into one 64-bit key.
+// Keys and values live in two parallel power-of-two arrays; probing walks the key array linearly
+// and touches a value only on a hit. The load factor is kept at or below 1/2.
+template<typename Value>
+class PairKeyTable {
+public:
+	static constexpr uint64_t EMPTY_KEY = ~uint64_t{ 0 };
+	static constexpr size_t NPOS = ~size_t{ 0 };
+
+	static uint64_t MakeKey(uint32_t first, uint32_t second) {
+		return (uint64_t{ first } << 32) | uint64_t{ second };
+	}
+
+	// Probes a key array laid out by this table, e.g. one read back from a snapshot.
+	// capacity must be zero or a power of two; returns the slot index or NPOS.
+	static size_t Find(const uint64_t* keys, size_t capacity, uint64_t key) {
+		if (capacity == 0u) {
+			return NPOS;
+		}
+		const size_t mask = capacity - 1u;
+		for (size_t idx = Hash(key) & mask;; idx = (idx + 1u) & mask) {
+			if (keys[idx] == key) {
+				return idx;
+			}
+			if (keys[idx] == EMPTY_KEY) {
+				return NPOS;
+			}
+		}
+	}
+
+	PairKeyTable() : _size(0u) {}
+
+	size_t size() const { return _size; }
+	bool empty() const { return _size == 0u; }
+	size_t capacity() const { return _keys.size(); }
+	const std::vector<uint64_t>& keys() const { return _keys; }
+	const std::vector<Value>& values() const { return _values; }
+
+	void clear() {
+		_keys.clear();
+		_values.clear();
+		_size = 0u;
+	}
+
+	// Adopts slot arrays produced by keys()/values() of another table as they are, without rehashing.
+	void assign(std::vector<uint64_t> keys, std::vector<Value> values) {
+		_keys = std::move(keys);
+		_values = std::move(values);
+		_size = 0u;
+		for (uint64_t key : _keys) {
+			if (key != EMPTY_KEY) {
+				++_size;
+			}
+		}
+	}
+
+	void reserve(size_t count) {
+		size_t capacity = MIN_CAPACITY;
+		while (capacity < count * 2u) {
+			capacity <<= 1;
+		}
+		if (capacity > _keys.size()) {
+			rehash(capacity);
+		}
+	}
+
+	bool insert(uint32_t first, uint32_t second, Value value) {
+		return emplace(MakeKey(first, second), std::move(value), false);
+	}
+
+	bool insert_or_assign(uint32_t first, uint32_t second, Value value) {
+		return emplace(MakeKey(first, second), std::move(value), true);
+	}
+
+	bool erase(uint32_t first, uint32_t second) {
+		size_t idx = Find(_keys.data(), _keys.size(), MakeKey(first, second));
+		if (idx == NPOS) {
+			return false;
+		}
+		// Backward-shift deletion: entries further along the probe run move into the hole unless
+		// that would put them before their home slot, so no tombstones are left behind.
+		const size_t mask = _keys.size() - 1u;
+		for (size_t next = (idx + 1u) & mask; _keys[next] != EMPTY_KEY; next = (next + 1u) & mask) {
+			const size_t home = Hash(_keys[next]) & mask;
+			if (((next - home) & mask) >= ((next - idx) & mask)) {
+				_keys[idx] = _keys[next];
+				_values[idx] = std::move(_values[next]);
+				idx = next;
+			}
+		}
+		_keys[idx] = EMPTY_KEY;
+		_values[idx] = Value();
+		--_size;
+		return true;
+	}
+
+	const Value* find(uint32_t first, uint32_t second) const {
+		const size_t idx = Find(_keys.data(), _keys.size(), MakeKey(first, second));
+		return idx == NPOS ? nullptr : &_values[idx];
+	}
+
+private:
+	static constexpr size_t MIN_CAPACITY = 16u;
+
+	static size_t Hash(uint64_t key) {
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdULL;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ULL;
+		key ^= key >> 33;
+		return static_cast<size_t>(key);
+	}
+
+	bool emplace(uint64_t key, Value value, bool assign) {
+		if ((_size + 1u) * 2u > _keys.size()) {
+			rehash(_keys.empty() ? MIN_CAPACITY : _keys.size() * 2u);
+		}
+		const size_t mask = _keys.size() - 1u;
+		for (size_t idx = Hash(key) & mask;; idx = (idx + 1u) & mask) {
+			if (_keys[idx] == key) {
+				if (assign) {
+					_values[idx] = std::move(value);
+				}
+				return false;
+			}
+			if (_keys[idx] == EMPTY_KEY) {
+				_keys[idx] = key;
+				_values[idx] = std::move(value);
+				++_size;
+				return true;
+			}
+		}
+	}
+
+	void rehash(size_t capacity) {
+		std::vector<uint64_t> old_keys(capacity, EMPTY_KEY);
+		std::vector<Value> old_values(capacity);
+		old_keys.swap(_keys);
+		old_values.swap(_values);
+		const size_t mask = _keys.size() - 1u;
+		for (size_t old_idx = 0; old_idx < old_keys.size(); ++old_idx) {
+			if (old_keys[old_idx] == EMPTY_KEY) {
+				continue;
+			}
+			size_t idx = Hash(old_keys[old_idx]) & mask;
+			while (_keys[idx] != EMPTY_KEY) {
+				idx = (idx + 1u) & mask;
+			}
+			_keys[idx] = old_keys[old_idx];
+			_values[idx] = std::move(old_values[old_idx]);
+		}
+	}
+
+	std::vector<uint64_t> _keys;
+	std::vector<Value> _values;
+	size_t _size;
+};
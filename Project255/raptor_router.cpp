@@ -0,0 +1,212 @@
+#include "raptor_router.h"
+
+#include <stdexcept>
+
+RaptorRouter::RaptorRouter(const TransportCatalogue& catalogue, const RoutingSettings& settings)
+	: _catalogue(catalogue), _settings(settings), _generation(catalogue.generation()), _stop_count(0) {
+	if (!catalogue.isFinalized()) {
+		throw std::logic_error("RaptorRouter needs a finalized catalogue"s);
+	}
+	if (!(settings.bus_velocity > 0.0) || settings.bus_wait_time < 0.0) {
+		throw std::invalid_argument("Routing needs a positive bus velocity and a non-negative wait time"s);
+	}
+	const CatalogueView& l = *catalogue.getAllRoutesInfoRef().layout;
+	_stop_count = static_cast<uint32_t>(l.stopCount());
+	const double meters_per_minute = settings.bus_velocity * 1000.0 / 60.0;
+
+	_ride_offsets.reserve(l.busCount() + 1u);
+	_ride_offsets.push_back(0u);
+	for (BusIdx bus = 0; bus < l.busCount(); ++bus) {
+		RouteRef route = l.route(bus);
+		const size_t n = route.stops.size();
+		for (size_t i = 0; i + 1u < n || (route.isRouteCircle && i < n); ++i) {
+			const StopIdx from = route.stops[i];
+			const StopIdx to = route.stops[i + 1u < n ? i + 1u : 0u];
+			_ride_times.push_back(catalogue.getFromDistanceOrLength(from, to) / meters_per_minute);
+			_return_times.push_back(route.isRouteCircle ? 0.0 : catalogue.getFromDistanceOrLength(to, from) / meters_per_minute);
+		}
+		_ride_offsets.push_back(_ride_times.size());
+	}
+}
+
+std::vector<RouteItinerary> RaptorRouter::findJourneys(StopIdx from, StopIdx to, uint32_t max_transfers) const {
+	return findJourneys(std::execution::seq, from, to, max_transfers);
+}
+
+const RoutingSettings& RaptorRouter::settings() const {
+	return _settings;
+}
+
+uint64_t RaptorRouter::generation() const {
+	return _generation;
+}
+
+RaptorRouter::Search& RaptorRouter::beginSearch(StopIdx from, StopIdx to) const {
+	if (from >= _stop_count || to >= _stop_count) {
+		throw std::out_of_range("Stop id out of the routing graph"s);
+	}
+	thread_local Search search;
+	if (search.best.size() < _stop_count) {
+		search.best.resize(_stop_count);
+		search.best_stamps.resize(_stop_count, 0u);
+		for (std::vector<Label>& labels : search.rounds) {
+			labels.resize(_stop_count, Label{});
+		}
+	}
+	if (++search.current == 0u) {
+		std::fill(search.best_stamps.begin(), search.best_stamps.end(), 0u);
+		for (std::vector<Label>& labels : search.rounds) {
+			for (Label& label : labels) {
+				label.stamp = 0u;
+			}
+		}
+		search.current = 1u;
+	}
+	if (search.rounds.empty()) {
+		search.rounds.emplace_back(search.best.size(), Label{});
+	}
+
+	search.target = to;
+	search.rounds[0][from] = { 0.0, 0.0, from, 0u, 0u, search.current };
+	search.best[from] = 0.0;
+	search.best_stamps[from] = search.current;
+	search.marked.assign(1u, from);
+	return search;
+}
+
+bool RaptorRouter::collectBuses(Search& search, uint32_t round) const {
+	if (search.marked.empty()) {
+		return false;
+	}
+	const size_t bus_count = _ride_offsets.size() - 1u;
+	if (search.bus_stamps.size() < bus_count) {
+		search.bus_stamps.resize(bus_count, 0u);
+	}
+	if (++search.bus_current == 0u) {
+		std::fill(search.bus_stamps.begin(), search.bus_stamps.end(), 0u);
+		search.bus_current = 1u;
+	}
+	search.buses.clear();
+	for (StopIdx stop : search.marked) {
+		for (BusIdx bus : _catalogue.findStopBuses(stop)) {
+			if (search.bus_stamps[bus] != search.bus_current) {
+				search.bus_stamps[bus] = search.bus_current;
+				search.buses.push_back(bus);
+			}
+		}
+	}
+	if (search.buses.empty()) {
+		return false;
+	}
+
+	if (search.rounds.size() <= round) {
+		search.rounds.emplace_back(search.best.size(), Label{});
+	}
+	const size_t items = search.buses.size();
+	const size_t chunk_count = std::min(items, ROUND_CHUNK_COUNT);
+	search.chunk_offsets.clear();
+	for (size_t chunk = 0; chunk <= chunk_count; ++chunk) {
+		search.chunk_offsets.push_back(chunk * items / chunk_count);
+	}
+	if (search.improvements.size() < chunk_count) {
+		search.improvements.resize(chunk_count);
+	}
+	return true;
+}
+
+void RaptorRouter::scanChunk(Search& search, uint32_t round, size_t chunk) const {
+	std::vector<Improvement>& out = search.improvements[chunk];
+	out.clear();
+	for (size_t item = search.chunk_offsets[chunk]; item < search.chunk_offsets[chunk + 1]; ++item) {
+		const BusIdx bus = search.buses[item];
+		RouteRef route = _catalogue.findRoute(bus);
+		const size_t n = route.stops.size();
+		const size_t offset = _ride_offsets[bus];
+		if (route.isRouteCircle) {
+			scanDirection(search, round, bus, n + 1u,
+				[&route, n](size_t i) { return route.stops[i < n ? i : 0u]; },
+				[this, offset](size_t i) { return _ride_times[offset + i]; },
+				out);
+		}
+		else {
+			scanDirection(search, round, bus, n,
+				[&route](size_t i) { return route.stops[i]; },
+				[this, offset](size_t i) { return _ride_times[offset + i]; },
+				out);
+			scanDirection(search, round, bus, n,
+				[&route, n](size_t i) { return route.stops[n - 1u - i]; },
+				[this, offset, n](size_t i) { return _return_times[offset + n - 2u - i]; },
+				out);
+		}
+	}
+}
+
+// Rides the bus along count stops. It is boarded wherever the previous round arrived early enough
+// for the wait to beat staying on, and every stop reached earlier than so far, and earlier than the
+// target, is reported.
+template<typename StopAt, typename RideTime>
+void RaptorRouter::scanDirection(const Search& search, uint32_t round, BusIdx bus, size_t count, StopAt&& stop_at, RideTime&& ride_time, std::vector<Improvement>& out) const {
+	const std::vector<Label>& previous = search.rounds[round - 1u];
+	const double target_time = search.bestOf(search.target);
+	bool boarded = false;
+	Label trip{};
+	for (size_t i = 0; i < count; ++i) {
+		const StopIdx stop = stop_at(i);
+		if (boarded) {
+			const double segment = ride_time(i - 1u);
+			trip.time += segment;
+			trip.ride_time += segment;
+			++trip.span_count;
+			if (trip.time < search.bestOf(stop) && trip.time < target_time) {
+				out.push_back({ stop, trip });
+			}
+		}
+		const Label& arrival = previous[stop];
+		if (arrival.stamp == search.current && (!boarded || arrival.time + _settings.bus_wait_time < trip.time)) {
+			trip = { arrival.time + _settings.bus_wait_time, 0.0, stop, bus, 0u, 0u };
+			boarded = true;
+		}
+	}
+}
+
+void RaptorRouter::mergeRound(Search& search, uint32_t round) const {
+	std::vector<Label>& labels = search.rounds[round];
+	search.marked.clear();
+	for (size_t chunk = 0; chunk + 1u < search.chunk_offsets.size(); ++chunk) {
+		for (const Improvement& improvement : search.improvements[chunk]) {
+			const double time = improvement.label.time;
+			if (!(time < search.bestOf(improvement.stop) && time < search.bestOf(search.target))) {
+				continue;
+			}
+			Label& label = labels[improvement.stop];
+			if (label.stamp != search.current) {
+				search.marked.push_back(improvement.stop);
+			}
+			label = improvement.label;
+			label.stamp = search.current;
+			search.best[improvement.stop] = time;
+			search.best_stamps[improvement.stop] = search.current;
+		}
+	}
+}
+
+std::vector<RouteItinerary> RaptorRouter::collectJourneys(const Search& search) const {
+	std::vector<RouteItinerary> res;
+	for (uint32_t round = 1; round < search.rounds.size(); ++round) {
+		const Label& arrival = search.rounds[round][search.target];
+		if (arrival.stamp != search.current) {
+			continue;
+		}
+		RouteItinerary journey{ arrival.time, {} };
+		StopIdx stop = search.target;
+		for (uint32_t k = round; k > 0u; --k) {
+			const Label& label = search.rounds[k][stop];
+			journey.legs.push_back({ RouteLegType::Ride, label.board, label.bus, label.span_count, label.ride_time });
+			journey.legs.push_back({ RouteLegType::Wait, label.board, 0u, 0u, _settings.bus_wait_time });
+			stop = label.board;
+		}
+		std::reverse(journey.legs.begin(), journey.legs.end());
+		res.push_back(std::move(journey));
+	}
+	return res;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include "domain.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+// Journeys between the stops of a finalized catalogue with the timing of TransportRouter, found by
+// rounds over the routes themselves (RAPTOR) instead of a graph. Round k scans, stop by stop, every
+// bus serving a stop that round k - 1 reached earlier than before, so after it each stop holds the
+// fastest arrival with at most k rides. This gives the journeys that are Pareto-optimal by transfers
+// and total time.
+//
+// Building a router only prepares the ride time of every route segment, linear in the route lengths,
+// so it suits catalogues that are edited too often to redo TransportRouter::Contract(). The buses of a
+// round are scanned in parallel under an execution policy; their results are merged in a fixed order,
+// so the journeys do not depend on the policy. Queries may be issued from several threads.
+class RaptorRouter {
+public:
+	static constexpr uint32_t UNLIMITED_TRANSFERS = std::numeric_limits<uint32_t>::max();
+	// Bus count from which scanning a round on the parallel execution policy pays off.
+	static constexpr size_t PARALLEL_BUS_THRESHOLD = 2048;
+
+	// The catalogue has to outlive the router and stay unchanged while it is in use; see generation().
+	RaptorRouter(const TransportCatalogue& catalogue, const RoutingSettings& settings);
+
+	// Journeys by increasing transfers, up to max_transfers, each strictly faster than those before
+	// it. Empty when no bus journey links the stops; a single journey with no legs when from == to.
+	std::vector<RouteItinerary> findJourneys(StopIdx from, StopIdx to, uint32_t max_transfers = UNLIMITED_TRANSFERS) const;
+	template<typename ExecutionPolicy>
+	std::vector<RouteItinerary> findJourneys(ExecutionPolicy&& policy, StopIdx from, StopIdx to, uint32_t max_transfers = UNLIMITED_TRANSFERS) const;
+
+	const RoutingSettings& settings() const;
+	// TransportCatalogue::generation() of the catalogue the router was built for.
+	uint64_t generation() const;
+
+private:
+	static constexpr size_t ROUND_CHUNK_COUNT = 64u;
+
+	// Arrival at a stop in a round: by bus, boarded at board, after span_count segments.
+	struct Label {
+		double time;
+		double ride_time;
+		StopIdx board;
+		BusIdx bus;
+		uint32_t span_count;
+		uint32_t stamp;
+	};
+
+	struct Improvement {
+		StopIdx stop;
+		Label label;
+	};
+
+	// Scratch of the queries of a thread. A label or arrival whose stamp differs from the current one
+	// is unset, so nothing is cleared between queries.
+	struct Search {
+		StopIdx target;
+		uint32_t current = 0;
+		uint32_t bus_current = 0;
+		// Earliest arrival at a stop over the rounds so far.
+		std::vector<double> best;
+		std::vector<uint32_t> best_stamps;
+		// rounds[k][stop] is set when round k improved the arrival at stop.
+		std::vector<std::vector<Label>> rounds;
+		std::vector<StopIdx> marked;
+		std::vector<uint32_t> bus_stamps;
+		std::vector<BusIdx> buses;
+		std::vector<size_t> chunk_offsets;
+		std::vector<std::vector<Improvement>> improvements;
+
+		double bestOf(StopIdx stop) const {
+			return best_stamps[stop] == current ? best[stop] : std::numeric_limits<double>::infinity();
+		}
+	};
+
+	Search& beginSearch(StopIdx from, StopIdx to) const;
+	bool collectBuses(Search& search, uint32_t round) const;
+	void scanChunk(Search& search, uint32_t round, size_t chunk) const;
+	template<typename StopAt, typename RideTime>
+	void scanDirection(const Search& search, uint32_t round, BusIdx bus, size_t count, StopAt&& stop_at, RideTime&& ride_time, std::vector<Improvement>& out) const;
+	void mergeRound(Search& search, uint32_t round) const;
+	std::vector<RouteItinerary> collectJourneys(const Search& search) const;
+
+	const TransportCatalogue& _catalogue;
+	RoutingSettings _settings;
+	uint64_t _generation;
+	uint32_t _stop_count;
+
+	// Segments of bus b span [_ride_offsets[b], _ride_offsets[b + 1]): the ride time from its i-th stop
+	// to the next one, the last stop of a circle route leading back to the first.
+	std::vector<size_t> _ride_offsets;
+	std::vector<double> _ride_times;
+	// The same segments ridden the other way, for the return direction of non-circle routes.
+	std::vector<double> _return_times;
+};
+
+template<typename ExecutionPolicy>
+inline std::vector<RouteItinerary> RaptorRouter::findJourneys(ExecutionPolicy&& policy, StopIdx from, StopIdx to, uint32_t max_transfers) const {
+	Search& search = beginSearch(from, to);
+	if (from == to) {
+		return { RouteItinerary{ 0.0, {} } };
+	}
+	std::vector<size_t> chunks;
+	for (uint32_t round = 1; round - 1u <= max_transfers && collectBuses(search, round); ++round) {
+		chunks.resize(search.chunk_offsets.size() - 1);
+		std::iota(chunks.begin(), chunks.end(), size_t{ 0 });
+		std::for_each(policy, chunks.cbegin(), chunks.cend(), [&](size_t chunk) { scanChunk(search, round, chunk); });
+		mergeRound(search, round);
+	}
+	return collectJourneys(search);
+}
@@ -2,6 +2,13 @@
 
 #include "json.h"
 #include "json_builder.h"
+#include "raptor_router.h"
+#include "transport_router.h"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <tuple>
 
 /*
  *          ,  ,  
@@ -12,19 +19,29 @@
  */
 
 void InputDataProcessor::Process(TransportCatalogue& transport_catalog, std::vector<std::unique_ptr<UserInputData>> userInputData) {
+	std::vector<StopLoadData> stops;
+	std::vector<BusLoadData> buses;
 	for (std::unique_ptr<UserInputData>& data : userInputData) {
 		if (data->getRequestType() == InputRequestType::RouteStop) {
 			RouteStopInputData* stopData = static_cast<RouteStopInputData*>(data.get());
-			transport_catalog.addRouteStop(stopData->getStopName(), stopData->getCoordinates(), std::move(stopData->getDistances()));
+			stops.push_back({ stopData->getStopName(), stopData->getCoordinates(), &stopData->getDistances() });
 		}
 		if (data->getRequestType() == InputRequestType::Bus) {
 			BusInputData* busData = static_cast<BusInputData*>(data.get());
-			transport_catalog.addRoute(std::move(busData->getBusID()), std::move(busData->getStopNames()), busData->getIsCircle());
+			buses.push_back({ busData->getBusID(), &busData->getStopNames(), busData->getIsCircle() });
 		}
 	}
+	if (stops.size() + buses.size() >= PARALLEL_LOAD_THRESHOLD) {
+		transport_catalog.Load(std::execution::par, stops, buses);
+		transport_catalog.Finalize(std::execution::par);
+	}
+	else {
+		transport_catalog.Load(stops, buses);
+		transport_catalog.Finalize();
+	}
 }
 
-StatDataProcessor::StatDataProcessor() : m_evt_mgr(new EventManager("Event Manager 1"s, false)) {}
+StatDataProcessor::StatDataProcessor() : m_evt_mgr(new EventManager("Event Manager 1"s, false)), m_route_cache(std::make_shared<RouteCache>(ROUTE_CACHE_CAPACITY)) {}
 
 void StatDataProcessor::Process(const TransportCatalogue& transport_catalog, std::vector<std::unique_ptr<UserStatData>> userStatData, std::ostream& out) {
 	m_evt_mgr->VTriggerEvent(std::shared_ptr<IEventData>(new EvtData_Before_Start_Processing(std::cout)));
@@ -49,6 +66,11 @@ void StatDataProcessor::Process(const TransportCatalogue& transport_catalog, std
 	m_evt_mgr->VTriggerEvent(std::shared_ptr<IEventData>(new EvtData_After_End_Processing(std::cout)));
 }
 
+void StatDataProcessor::Process(const CatalogueStore& store, std::vector<std::unique_ptr<UserStatData>> userStatData, std::ostream& out) {
+	CatalogueStore::Reader reader = store.acquire();
+	Process(reader.catalogue(), std::move(userStatData), out);
+}
+
 int StatDataProcessor::_ct = 0;
 
 int StatDataProcessor::RegisterProcess(StatRequestType rt, ProcessFn fn) {
@@ -60,20 +82,25 @@ void StatDataProcessor::RegisterEventListener(const EventListenerDelegate& event
 	m_evt_mgr->VAddListener(eventDelegate, type);
 }
 
+const std::shared_ptr<RouteCache>& StatDataProcessor::GetRouteCache() const {
+	return m_route_cache;
+}
+
 void ProcessBus(const TransportCatalogue& transport_catalog, const std::unique_ptr<UserStatData>& userStatData, std::ostream& out) {
 
 	BusStatInputData* stopData = static_cast<BusStatInputData*>(userStatData.get());
 	BusID& bid = stopData->getBusID();
-	if (transport_catalog.isBusIDExists(bid)) {
+	std::optional<BusIdx> bus = transport_catalog.findBusIdx(bid);
+	if (bus) {
 		std::ios::fmtflags oldFlag = out.flags();
 
 		out << std::setprecision(6);
 		out << "Bus " << bid << ": ";
 
-		const Route& rt = transport_catalog.findRouteByBusID(bid);
-		out << (rt.isRouteCircle ? rt.stops.size() + 1 : rt.stops.size() + rt.stops.size() - 1) << " stops on route, ";
-		out << rt.stops.size() << " unique stops, ";
-		out << transport_catalog.routeLength(bid) << " route length";
+		const RouteStats& stats = transport_catalog.findRouteStats(*bus);
+		out << stats.stop_count << " stops on route, ";
+		out << stats.unique_stop_count << " unique stops, ";
+		out << stats.length << " route length";
 
 		out.flags(oldFlag);
 	}
@@ -87,19 +114,18 @@ void ProcessBusDistance(const TransportCatalogue& transport_catalog, const std::
 
 	BusStatInputData* stopData = static_cast<BusStatInputData*>(userStatData.get());
 	BusID& bid = stopData->getBusID();
-	if (transport_catalog.isBusIDExists(bid)) {
+	std::optional<BusIdx> bus = transport_catalog.findBusIdx(bid);
+	if (bus) {
 		std::ios::fmtflags oldFlag = out.flags();
 
 		out << std::setprecision(6);
 		out << "Bus " << bid << ": ";
 
-		const Route& rt = transport_catalog.findRouteByBusID(bid);
-		out << (rt.isRouteCircle ? rt.stops.size() + 1 : rt.stops.size() + rt.stops.size() - 1) << " stops on route, ";
-		out << rt.stops.size() << " unique stops, ";
-		double d = transport_catalog.routeDistance(bid);
-		double l = transport_catalog.routeLength(bid);
-		out << d << " route length, ";
-		out << (d / l) << " curvature";
+		const RouteStats& stats = transport_catalog.findRouteStats(*bus);
+		out << stats.stop_count << " stops on route, ";
+		out << stats.unique_stop_count << " unique stops, ";
+		out << stats.distance << " route length, ";
+		out << stats.curvature << " curvature";
 
 		out.flags(oldFlag);
 	}
@@ -109,21 +135,51 @@ void ProcessBusDistance(const TransportCatalogue& transport_catalog, const std::
 	out << std::endl;
 }
 
+// Section of the bus between the two stops, empty when the bus or a stop is unknown or not on the route.
+std::optional<RouteSection> FindBusSection(const TransportCatalogue& transport_catalog, BusSectionStatInputData* sectionData) {
+	std::optional<BusIdx> bus = transport_catalog.findBusIdx(sectionData->getBusID());
+	std::optional<StopIdx> from = transport_catalog.findStopIdx(sectionData->getFrom());
+	std::optional<StopIdx> to = transport_catalog.findStopIdx(sectionData->getTo());
+	if (!bus || !from || !to) {
+		return std::nullopt;
+	}
+	return transport_catalog.findRouteSection(*bus, *from, *to);
+}
+
+void ProcessBusSection(const TransportCatalogue& transport_catalog, const std::unique_ptr<UserStatData>& userStatData, std::ostream& out) {
+
+	BusSectionStatInputData* sectionData = static_cast<BusSectionStatInputData*>(userStatData.get());
+	out << "Bus " << sectionData->getBusID() << " from " << sectionData->getFrom() << " to " << sectionData->getTo() << ": ";
+	std::optional<RouteSection> section = FindBusSection(transport_catalog, sectionData);
+	if (section) {
+		std::ios::fmtflags oldFlag = out.flags();
+
+		out << std::setprecision(6);
+		out << section->stop_count << " stops on section, ";
+		out << section->distance << " route length, ";
+		out << section->length << " geo length";
+
+		out.flags(oldFlag);
+	}
+	else {
+		out << "not found";
+	}
+	out << std::endl;
+}
+
 void ProcessBusDistanceJson(const TransportCatalogue& transport_catalog, const std::unique_ptr<UserStatData>& userStatData, std::ostream& out) {
 	json::Dict res;
 	res.insert({ "request_id"s, userStatData->getRequestID() });
 	BusStatInputData* stopData = static_cast<BusStatInputData*>(userStatData.get());
 	BusID& bid = stopData->getBusID();
-	if (transport_catalog.isBusIDExists(bid)) {
-		const Route& rt = transport_catalog.findRouteByBusID(bid);
-
-		res.insert({ "stop_count"s, (int)(rt.isRouteCircle ? rt.stops.size() + 1 : rt.stops.size() + rt.stops.size() - 1) });
-		res.insert({ "unique_stop_count"s, (int)rt.stops.size() });
-
-		double d = transport_catalog.routeDistance(bid);
-		double l = transport_catalog.routeLength(bid);
-		res.insert({ "route_length"s, d });
-		res.insert({ "curvature"s, (d / l) });
+	std::optional<BusIdx> bus = transport_catalog.findBusIdx(bid);
+	if (bus) {
+		const RouteStats& stats = transport_catalog.findRouteStats(*bus);
+
+		res.insert({ "stop_count"s, (int)stats.stop_count });
+		res.insert({ "unique_stop_count"s, (int)stats.unique_stop_count });
+		res.insert({ "route_length"s, stats.distance });
+		res.insert({ "curvature"s, stats.curvature });
 	}
 	else {
 		res.insert({ "error_message"s, "not found"s });
@@ -139,16 +195,15 @@ void ProcessBusDistanceJson2(const TransportCatalogue& transport_catalog, const
 
 	BusStatInputData* stopData = static_cast<BusStatInputData*>(userStatData.get());
 	BusID& bid = stopData->getBusID();
-	if (transport_catalog.isBusIDExists(bid)) {
-		const Route& rt = transport_catalog.findRouteByBusID(bid);
+	std::optional<BusIdx> bus = transport_catalog.findBusIdx(bid);
+	if (bus) {
+		const RouteStats& stats = transport_catalog.findRouteStats(*bus);
 
-		double d = transport_catalog.routeDistance(bid);
-		double l = transport_catalog.routeLength(bid);
 		builder
-			.Key("stop_count"s).Value((int)(rt.isRouteCircle ? rt.stops.size() + 1 : rt.stops.size() + rt.stops.size() - 1))
-			.Key("unique_stop_count"s).Value((int)rt.stops.size())
-			.Key("route_length"s).Value(d)
-			.Key("curvature"s).Value((d / l));
+			.Key("stop_count"s).Value((int)stats.stop_count)
+			.Key("unique_stop_count"s).Value((int)stats.unique_stop_count)
+			.Key("route_length"s).Value(stats.distance)
+			.Key("curvature"s).Value(stats.curvature);
 	}
 	else {
 		builder
@@ -158,21 +213,42 @@ void ProcessBusDistanceJson2(const TransportCatalogue& transport_catalog, const
 	json::Print(json::Document{ builder.Build()}, out);
 }
 
+void ProcessBusSectionJson2(const TransportCatalogue& transport_catalog, const std::unique_ptr<UserStatData>& userStatData, std::ostream& out) {
+	json::Builder builder{};
+	builder.StartDict()
+		.Key("request_id"s).Value(userStatData->getRequestID());
+
+	std::optional<RouteSection> section = FindBusSection(transport_catalog, static_cast<BusSectionStatInputData*>(userStatData.get()));
+	if (section) {
+		builder
+			.Key("stop_count"s).Value((int)section->stop_count)
+			.Key("route_length"s).Value(section->distance)
+			.Key("geo_length"s).Value(section->length);
+	}
+	else {
+		builder
+			.Key("error_message"s).Value("not found"s);
+	}
+	builder.EndDict();
+	json::Print(json::Document{ builder.Build() }, out);
+}
+
 void ProcessStopJson(const TransportCatalogue& transport_catalog, const std::unique_ptr<UserStatData>& userStatData, std::ostream& out) {
 	json::Dict res;
 	res.insert({ "request_id"s, userStatData->getRequestID() });
 	StopStatInputData* stopData = static_cast<StopStatInputData*>(userStatData.get());
 	std::string& stopName = stopData->getStopName();
-	if (transport_catalog.isStopNameExists(stopName)) {
-		std::vector<Trace> traces = transport_catalog.findTracesByStopName(stopName);
-		if (traces.size() == 0) {
+	std::optional<StopIdx> stop = transport_catalog.findStopIdx(stopName);
+	if (stop) {
+		Span<BusIdx> buses = transport_catalog.findStopBuses(*stop);
+		if (buses.empty()) {
 			res.insert({ "error_message"s, "not found"s });
 		}
 		else {
 			json::Array arrayRes;
-			arrayRes.reserve(traces.size());
-			for (Trace trace : traces) {
-				arrayRes.push_back(json::Node(trace.bus_num));
+			arrayRes.reserve(buses.size());
+			for (BusIdx bus : buses) {
+				arrayRes.push_back(json::Node(BusID(transport_catalog.getBusName(bus))));
 			}
 			res.insert({ "buses"s, arrayRes });
 		}
@@ -190,9 +266,10 @@ void ProcessStopJson2(const TransportCatalogue& transport_catalog, const std::un
 
 	StopStatInputData* stopData = static_cast<StopStatInputData*>(userStatData.get());
 	std::string& stopName = stopData->getStopName();
-	if (transport_catalog.isStopNameExists(stopName)) {
-		std::vector<Trace> traces = transport_catalog.findTracesByStopName(stopName);
-		if (traces.size() == 0) {
+	std::optional<StopIdx> stop = transport_catalog.findStopIdx(stopName);
+	if (stop) {
+		Span<BusIdx> buses = transport_catalog.findStopBuses(*stop);
+		if (buses.empty()) {
 			builder
 				.Key("error_message"s).Value("not found"s);
 		}
@@ -200,8 +277,8 @@ void ProcessStopJson2(const TransportCatalogue& transport_catalog, const std::un
 			builder
 				.Key("buses"s)
 				.StartArray();
-			for (Trace trace : traces) {
-				builder.Key(trace.bus_num);
+			for (BusIdx bus : buses) {
+				builder.Value(BusID(transport_catalog.getBusName(bus)));
 			}
 			builder.EndArray();
 		}
@@ -257,13 +334,428 @@ void ProcessMapJson2(const TransportCatalogue& transport_catalog, const std::uni
 	);
 }
 
+void ProcessNearestStopsJson2(const TransportCatalogue& transport_catalog, const std::unique_ptr<UserStatData>& userStatData, std::ostream& out) {
+	NearestStopsStatInputData* nearestData = static_cast<NearestStopsStatInputData*>(userStatData.get());
+	const size_t count = static_cast<size_t>(std::max(nearestData->getCount(), 0));
+
+	json::Builder builder{};
+	builder.StartDict()
+		.Key("request_id"s).Value(userStatData->getRequestID())
+		.Key("stops"s)
+		.StartArray();
+	for (const auto& [stop, distance] : transport_catalog.findNearestStops(nearestData->getPoint(), count)) {
+		builder
+			.StartDict()
+				.Key("name"s).Value(RouteStopName(transport_catalog.getStopName(stop)))
+				.Key("distance"s).Value(distance)
+			.EndDict();
+	}
+	builder
+		.EndArray()
+		.EndDict();
+	json::Print(json::Document{ builder.Build() }, out);
+}
+
+void ProcessAreaJson2(const TransportCatalogue& transport_catalog, const std::unique_ptr<UserStatData>& userStatData, std::ostream& out) {
+	AreaStatInputData* areaData = static_cast<AreaStatInputData*>(userStatData.get());
+
+	std::vector<std::string_view> stop_names;
+	std::vector<std::string_view> bus_names;
+	for (StopIdx stop : transport_catalog.findStopsInArea(areaData->getArea())) {
+		stop_names.push_back(transport_catalog.getStopName(stop));
+		for (BusIdx bus : transport_catalog.findStopBuses(stop)) {
+			bus_names.push_back(transport_catalog.getBusName(bus));
+		}
+	}
+	std::sort(stop_names.begin(), stop_names.end());
+	std::sort(bus_names.begin(), bus_names.end());
+	bus_names.erase(std::unique(bus_names.begin(), bus_names.end()), bus_names.end());
+
+	json::Builder builder{};
+	builder.StartDict()
+		.Key("request_id"s).Value(userStatData->getRequestID())
+		.Key("stops"s)
+		.StartArray();
+	for (std::string_view name : stop_names) {
+		builder.Value(RouteStopName(name));
+	}
+	builder
+		.EndArray()
+		.Key("buses"s)
+		.StartArray();
+	for (std::string_view name : bus_names) {
+		builder.Value(BusID(name));
+	}
+	builder
+		.EndArray()
+		.EndDict();
+	json::Print(json::Document{ builder.Build() }, out);
+}
+
+void ProcessSharedBusesJson2(const TransportCatalogue& transport_catalog, const std::unique_ptr<UserStatData>& userStatData, std::ostream& out) {
+	SharedBusesStatInputData* sharedData = static_cast<SharedBusesStatInputData*>(userStatData.get());
+
+	json::Builder builder{};
+	builder.StartDict()
+		.Key("request_id"s).Value(userStatData->getRequestID());
+
+	std::optional<StopIdx> first = transport_catalog.findStopIdx(sharedData->getFirstStop());
+	std::optional<StopIdx> second = transport_catalog.findStopIdx(sharedData->getSecondStop());
+	if (first && second) {
+		std::vector<std::string_view> bus_names;
+		for (BusIdx bus : transport_catalog.findSharedBuses(*first, *second)) {
+			bus_names.push_back(transport_catalog.getBusName(bus));
+		}
+		std::sort(bus_names.begin(), bus_names.end());
+		builder
+			.Key("buses"s)
+			.StartArray();
+		for (std::string_view name : bus_names) {
+			builder.Value(BusID(name));
+		}
+		builder.EndArray();
+	}
+	else {
+		builder
+			.Key("error_message"s).Value("not found"s);
+	}
+	builder.EndDict();
+	json::Print(json::Document{ builder.Build() }, out);
+}
+
+void ProcessTransferStopsJson2(const TransportCatalogue& transport_catalog, const std::unique_ptr<UserStatData>& userStatData, std::ostream& out) {
+	TransferStopsStatInputData* transferData = static_cast<TransferStopsStatInputData*>(userStatData.get());
+
+	json::Builder builder{};
+	builder.StartDict()
+		.Key("request_id"s).Value(userStatData->getRequestID());
+
+	std::optional<BusIdx> first = transport_catalog.findBusIdx(transferData->getFirstBus());
+	std::optional<BusIdx> second = transport_catalog.findBusIdx(transferData->getSecondBus());
+	if (first && second) {
+		std::vector<std::string_view> stop_names;
+		for (StopIdx stop : transport_catalog.findTransferStops(*first, *second)) {
+			stop_names.push_back(transport_catalog.getStopName(stop));
+		}
+		std::sort(stop_names.begin(), stop_names.end());
+		builder
+			.Key("stops"s)
+			.StartArray();
+		for (std::string_view name : stop_names) {
+			builder.Value(RouteStopName(name));
+		}
+		builder.EndArray();
+	}
+	else {
+		builder
+			.Key("error_message"s).Value("not found"s);
+	}
+	builder.EndDict();
+	json::Print(json::Document{ builder.Build() }, out);
+}
+
+// Routers of the latest catalogue generations and routing settings. Each is built on the first request
+// for its key, with the options after the catalogue and settings, and shared by the copies of a
+// processor. At most ROUTERS are kept; a new key evicts the router of the oldest generation, and a
+// request for a generation older than every kept router, e.g. from a reader holding a long retired
+// version, gets a router of its own. Readers of two versions served side by side thus share a
+// router each instead of rebuilding one for each other in turn.
+template<typename Router, typename... Options>
+class SharedRouter {
+public:
+	explicit SharedRouter(Options... options) : _options(options...) {}
+
+	std::shared_ptr<const Router> get(const TransportCatalogue& transport_catalog, const RoutingSettings& settings) const {
+		std::lock_guard<std::mutex> lock(_shared->mutex);
+		std::vector<std::shared_ptr<const Router>>& routers = _shared->routers;
+		for (const std::shared_ptr<const Router>& router : routers) {
+			if (router->generation() == transport_catalog.generation()
+				&& router->settings().bus_wait_time == settings.bus_wait_time
+				&& router->settings().bus_velocity == settings.bus_velocity) {
+				return router;
+			}
+		}
+		std::shared_ptr<const Router> router = std::apply([&](const Options&... options) {
+			return std::make_shared<const Router>(transport_catalog, settings, options...);
+		}, _options);
+		if (routers.size() < ROUTERS) {
+			routers.push_back(router);
+			return router;
+		}
+		auto oldest = std::min_element(routers.begin(), routers.end(), [](const auto& lhs, const auto& rhs) {
+			return lhs->generation() < rhs->generation();
+		});
+		if ((*oldest)->generation() <= transport_catalog.generation()) {
+			*oldest = router;
+		}
+		return router;
+	}
+
+private:
+	static constexpr size_t ROUTERS = 2u;
+
+	struct Shared {
+		std::mutex mutex;
+		std::vector<std::shared_ptr<const Router>> routers;
+	};
+
+	std::shared_ptr<Shared> _shared = std::make_shared<Shared>();
+	std::tuple<Options...> _options;
+};
+
+void BuildRouteItems(json::Builder& builder, const TransportCatalogue& transport_catalog, const RouteItinerary& itinerary) {
+	builder
+		.Key("items"s)
+		.StartArray();
+	for (const RouteLeg& leg : itinerary.legs) {
+		if (leg.type == RouteLegType::Wait) {
+			builder
+				.StartDict()
+					.Key("type"s).Value("Wait"s)
+					.Key("stop_name"s).Value(RouteStopName(transport_catalog.getStopName(leg.stop)))
+					.Key("time"s).Value(leg.time)
+				.EndDict();
+		}
+		else {
+			builder
+				.StartDict()
+					.Key("type"s).Value("Bus"s)
+					.Key("bus"s).Value(BusID(transport_catalog.getBusName(leg.bus)))
+					.Key("span_count"s).Value(static_cast<int>(leg.span_count))
+					.Key("time"s).Value(leg.time)
+				.EndDict();
+		}
+	}
+	builder.EndArray();
+}
+
+// Answers Route requests with the fastest journey, looked up in the cache first.
+class RouteJsonProcess {
+public:
+	explicit RouteJsonProcess(std::shared_ptr<RouteCache> cache) : _cache(std::move(cache)) {}
+
+	void operator()(const TransportCatalogue& transport_catalog, const std::unique_ptr<UserStatData>& userStatData, std::ostream& out) const {
+		RouteStatInputData* routeData = static_cast<RouteStatInputData*>(userStatData.get());
+
+		json::Builder builder{};
+		builder.StartDict()
+			.Key("request_id"s).Value(userStatData->getRequestID());
+
+		std::optional<StopIdx> from = transport_catalog.findStopIdx(routeData->getFrom());
+		std::optional<StopIdx> to = transport_catalog.findStopIdx(routeData->getTo());
+		std::optional<RouteItinerary> itinerary;
+		if (from && to) {
+			const RoutingSettings& settings = routeData->getRoutingSettings();
+			itinerary = _cache->getOrCompute(transport_catalog.generation(), RouteQuery{ *from, *to, settings }, [&]() {
+				return _router.get(transport_catalog, settings)->findRoute(*from, *to);
+			});
+		}
+		if (itinerary) {
+			builder
+				.Key("total_time"s).Value(itinerary->total_time);
+			BuildRouteItems(builder, transport_catalog, *itinerary);
+		}
+		else {
+			builder
+				.Key("error_message"s).Value("not found"s);
+		}
+		builder.EndDict();
+		json::Print(json::Document{ builder.Build() }, out);
+	}
+
+private:
+	std::shared_ptr<RouteCache> _cache;
+	SharedRouter<TransportRouter> _router;
+};
+
+// Answers Journeys requests with the journeys that trade transfers for time, fewest transfers first.
+class JourneysJsonProcess {
+public:
+	void operator()(const TransportCatalogue& transport_catalog, const std::unique_ptr<UserStatData>& userStatData, std::ostream& out) const {
+		JourneysStatInputData* journeysData = static_cast<JourneysStatInputData*>(userStatData.get());
+
+		json::Builder builder{};
+		builder.StartDict()
+			.Key("request_id"s).Value(userStatData->getRequestID());
+
+		std::optional<StopIdx> from = transport_catalog.findStopIdx(journeysData->getFrom());
+		std::optional<StopIdx> to = transport_catalog.findStopIdx(journeysData->getTo());
+		std::vector<RouteItinerary> journeys;
+		if (from && to) {
+			std::shared_ptr<const RaptorRouter> router = _router.get(transport_catalog, journeysData->getRoutingSettings());
+			if (transport_catalog.getAllRoutesInfoRef().layout->busCount() >= RaptorRouter::PARALLEL_BUS_THRESHOLD) {
+				journeys = router->findJourneys(std::execution::par, *from, *to, journeysData->getMaxTransfers());
+			}
+			else {
+				journeys = router->findJourneys(*from, *to, journeysData->getMaxTransfers());
+			}
+		}
+		if (!journeys.empty()) {
+			builder
+				.Key("journeys"s)
+				.StartArray();
+			for (const RouteItinerary& journey : journeys) {
+				const size_t rides = journey.legs.size() / 2u;
+				builder
+					.StartDict()
+						.Key("transfers"s).Value(static_cast<int>(rides > 0u ? rides - 1u : 0u))
+						.Key("total_time"s).Value(journey.total_time);
+				BuildRouteItems(builder, transport_catalog, journey);
+				builder.EndDict();
+			}
+			builder.EndArray();
+		}
+		else {
+			builder
+				.Key("error_message"s).Value("not found"s);
+		}
+		builder.EndDict();
+		json::Print(json::Document{ builder.Build() }, out);
+	}
+
+private:
+	SharedRouter<RaptorRouter> _router;
+};
+
+// Answers Matrix requests with the travel times from every origin to every destination, null where
+// a stop is unknown or no bus journey links the two.
+class MatrixJsonProcess {
+public:
+	void operator()(const TransportCatalogue& transport_catalog, const std::unique_ptr<UserStatData>& userStatData, std::ostream& out) const {
+		MatrixStatInputData* matrixData = static_cast<MatrixStatInputData*>(userStatData.get());
+
+		// Known stops only; unknown ones keep a null row or column.
+		auto resolve = [&transport_catalog](const std::vector<std::string>& names, std::vector<StopIdx>& stops, std::vector<size_t>& positions) {
+			for (size_t i = 0; i < names.size(); ++i) {
+				if (std::optional<StopIdx> stop = transport_catalog.findStopIdx(names[i])) {
+					stops.push_back(*stop);
+					positions.push_back(i);
+				}
+			}
+		};
+		std::vector<StopIdx> origins;
+		std::vector<size_t> origin_rows;
+		resolve(matrixData->getOrigins(), origins, origin_rows);
+		std::vector<StopIdx> destinations;
+		std::vector<size_t> destination_columns;
+		resolve(matrixData->getDestinations(), destinations, destination_columns);
+
+		const size_t columns = matrixData->getDestinations().size();
+		std::vector<double> times(matrixData->getOrigins().size() * columns, std::numeric_limits<double>::infinity());
+		if (!origins.empty() && !destinations.empty()) {
+			std::shared_ptr<const TransportRouter> router = _router.get(transport_catalog, matrixData->getRoutingSettings());
+			const std::vector<double> found = origins.size() >= TransportRouter::PARALLEL_ORIGIN_THRESHOLD
+				? router->findTravelTimes(std::execution::par, origins, destinations)
+				: router->findTravelTimes(origins, destinations);
+			for (size_t i = 0; i < origins.size(); ++i) {
+				for (size_t j = 0; j < destinations.size(); ++j) {
+					times[origin_rows[i] * columns + destination_columns[j]] = found[i * destinations.size() + j];
+				}
+			}
+		}
+
+		json::Builder builder{};
+		builder.StartDict()
+			.Key("request_id"s).Value(userStatData->getRequestID())
+			.Key("times"s)
+			.StartArray();
+		for (size_t row = 0; row < matrixData->getOrigins().size(); ++row) {
+			builder.StartArray();
+			for (size_t column = 0; column < columns; ++column) {
+				const double time = times[row * columns + column];
+				if (time < std::numeric_limits<double>::infinity()) {
+					builder.Value(time);
+				}
+				else {
+					builder.Value(nullptr);
+				}
+			}
+			builder.EndArray();
+		}
+		builder
+			.EndArray()
+			.EndDict();
+		json::Print(json::Document{ builder.Build() }, out);
+	}
+
+private:
+	SharedRouter<TransportRouter> _router;
+};
+
+// Answers Isochrone requests with the stops reachable within the time or distance limit, nearest first,
+// and the map with those stops overlaid when asked to render.
+class IsochroneJsonProcess {
+public:
+	void operator()(const TransportCatalogue& transport_catalog, const std::unique_ptr<UserStatData>& userStatData, std::ostream& out) const {
+		IsochroneStatInputData* isochroneData = static_cast<IsochroneStatInputData*>(userStatData.get());
+
+		json::Builder builder{};
+		builder.StartDict()
+			.Key("request_id"s).Value(userStatData->getRequestID());
+
+		std::optional<StopIdx> from = transport_catalog.findStopIdx(isochroneData->getFrom());
+		if (!from) {
+			builder
+				.Key("error_message"s).Value("not found"s)
+				.EndDict();
+			json::Print(json::Document{ builder.Build() }, out);
+			return;
+		}
+
+		// With no wait, the time of a journey is the distance ridden over the velocity.
+		const RoutingSettings& settings = isochroneData->getRoutingSettings();
+		const bool by_distance = isochroneData->getLimitType() == IsochroneLimit::Distance;
+		const double meters_per_minute = settings.bus_velocity * 1000.0 / 60.0;
+		std::vector<std::pair<StopIdx, double>> reached;
+		if (by_distance) {
+			reached = _distance_router.get(transport_catalog, { 0.0, settings.bus_velocity })->findReachable(*from, isochroneData->getLimit() / meters_per_minute);
+			for (auto& [stop, cost] : reached) {
+				cost *= meters_per_minute;
+			}
+		}
+		else {
+			reached = _time_router.get(transport_catalog, settings)->findReachable(*from, isochroneData->getLimit());
+		}
+
+		builder
+			.Key("stops"s)
+			.StartArray();
+		for (const auto& [stop, cost] : reached) {
+			builder
+				.StartDict()
+					.Key("stop_name"s).Value(RouteStopName(transport_catalog.getStopName(stop)))
+					.Key(by_distance ? "distance"s : "time"s).Value(cost)
+				.EndDict();
+		}
+		builder.EndArray();
+
+		if (const std::optional<RenderSettings>& render_settings = isochroneData->getRenderSettings()) {
+			svg::Document doc;
+			RoutePictureRef picture(*render_settings, transport_catalog.getAllRoutesInfoRef());
+			picture.SetReachableStops(std::move(reached), isochroneData->getLimit());
+			picture.Draw(doc);
+
+			std::ostringstream myString;
+			doc.Render(myString);
+			builder.Key("map"s).Value(myString.str());
+		}
+		builder.EndDict();
+		json::Print(json::Document{ builder.Build() }, out);
+	}
+
+private:
+	SharedRouter<TransportRouter, bool> _time_router{ false };
+	SharedRouter<TransportRouter, bool> _distance_router{ false };
+};
+
 void ProcessStop(const TransportCatalogue& transport_catalog, const std::unique_ptr<UserStatData>& userStatData, std::ostream& out) {
 
 	StopStatInputData* stopData = static_cast<StopStatInputData*>(userStatData.get());
 	std::string& stopName = stopData->getStopName();
-	if (transport_catalog.isStopNameExists(stopName)) {
-		std::vector<Trace> traces = transport_catalog.findTracesByStopName(stopName);
-		if (traces.size() == 0) {
+	std::optional<StopIdx> stop = transport_catalog.findStopIdx(stopName);
+	if (stop) {
+		Span<BusIdx> buses = transport_catalog.findStopBuses(*stop);
+		if (buses.empty()) {
 			out << "Stop " << stopName << ": not found";
 		}
 		else {
@@ -272,8 +764,8 @@ void ProcessStop(const TransportCatalogue& transport_catalog, const std::unique_
 			out << std::setprecision(6);
 			out << "Stop " << stopName << ": buses";
 
-			for (Trace trace : traces) {
-				out << " "s << trace.bus_num;
+			for (BusIdx bus : buses) {
+				out << " "s << transport_catalog.getBusName(bus);
 			}
 
 			out.flags(oldFlag);
@@ -307,11 +799,21 @@ StatDataProcessor StatDataProcessorFactory::Create(StreamType st) {
 	if (st == StreamType::TEXT) {
 		res.RegisterProcess(StatRequestType::BusStat, ProcessBusDistance);
 		res.RegisterProcess(StatRequestType::StopStat, ProcessStop);
+		res.RegisterProcess(StatRequestType::BusSection, ProcessBusSection);
 	}
 	if (st == StreamType::JSON) {
 		res.RegisterProcess(StatRequestType::BusStat, ProcessBusDistanceJson2);
 		res.RegisterProcess(StatRequestType::StopStat, ProcessStopJson2);
+		res.RegisterProcess(StatRequestType::BusSection, ProcessBusSectionJson2);
 		res.RegisterProcess(StatRequestType::Map, ProcessMapJson2);
+		res.RegisterProcess(StatRequestType::NearestStops, ProcessNearestStopsJson2);
+		res.RegisterProcess(StatRequestType::Area, ProcessAreaJson2);
+		res.RegisterProcess(StatRequestType::SharedBuses, ProcessSharedBusesJson2);
+		res.RegisterProcess(StatRequestType::TransferStops, ProcessTransferStopsJson2);
+		res.RegisterProcess(StatRequestType::Route, RouteJsonProcess(res.GetRouteCache()));
+		res.RegisterProcess(StatRequestType::Journeys, JourneysJsonProcess());
+		res.RegisterProcess(StatRequestType::Matrix, MatrixJsonProcess());
+		res.RegisterProcess(StatRequestType::Isochrone, IsochroneJsonProcess());
 		res.RegisterEventListener({ connect_arg<&StartEventHandlerJson> }, EvtData_Before_Start_Processing::sk_EventType);
 		res.RegisterEventListener({ connect_arg<&EndEventHandlerJson> }, EvtData_After_End_Processing::sk_EventType);
 		res.RegisterEventListener({ connect_arg<&MidEventHandlerJson> }, EvtData_Before_User_Data_Processing::sk_EventType);
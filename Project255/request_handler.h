@@ -6,11 +6,15 @@
 #include <type_traits>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <vector>
 
 #include "transport_catalogue.h"
+#include "catalogue_store.h"
 #include "domain.h"
+#include "lru_cache.h"
 #include "map_renderer.h"
+#include "transport_router.h"
 
 
 /*
@@ -51,21 +55,57 @@
 
 class InputDataProcessor {
 public:
+    // Base requests from this count on are loaded and finalized on the parallel execution policy;
+    // the catalogue built is the same either way.
+    static constexpr size_t PARALLEL_LOAD_THRESHOLD = 4096;
+
     static void Process(TransportCatalogue& transport_catalog, std::vector<std::unique_ptr<UserInputData>>);
 };
 
+// Route request as far as its answer goes: the settings are part of it, the request id is not.
+struct RouteQuery {
+    StopIdx from;
+    StopIdx to;
+    RoutingSettings settings;
+
+    bool operator==(const RouteQuery& other) const {
+        return from == other.from && to == other.to
+            && settings.bus_wait_time == other.settings.bus_wait_time
+            && settings.bus_velocity == other.settings.bus_velocity;
+    }
+};
+
+struct RouteQueryHasher {
+    size_t operator()(const RouteQuery& query) const {
+        size_t h = std::hash<uint64_t>{}((uint64_t{ query.from } << 32) | uint64_t{ query.to });
+        h = h * 31u + std::hash<double>{}(query.settings.bus_wait_time);
+        return h * 31u + std::hash<double>{}(query.settings.bus_velocity);
+    }
+};
+
+// Answers of Route requests, "not found" ones included.
+using RouteCache = LruCache<RouteQuery, std::optional<RouteItinerary>, RouteQueryHasher>;
+
 class StatDataProcessor {
 public:
     using ProcessFn = std::function<void(const TransportCatalogue&, const std::unique_ptr<UserStatData>&, std::ostream&)>;
+    // Route answers kept across the batches of a processor and its copies.
+    static constexpr size_t ROUTE_CACHE_CAPACITY = 4096;
 
     StatDataProcessor();
 
     void Process(const TransportCatalogue& transport_catalog, std::vector<std::unique_ptr<UserStatData>>, std::ostream& out);
+    // Answers the whole batch from the catalogue version current when it starts, even if a newer one
+    // is published meanwhile.
+    void Process(const CatalogueStore& store, std::vector<std::unique_ptr<UserStatData>>, std::ostream& out);
     int RegisterProcess(StatRequestType rt, ProcessFn fn);
     void RegisterEventListener(const EventListenerDelegate& eventDelegate, const EventTypeId& type);
+    // Shared with the Route processes registered by StatDataProcessorFactory; stats() counts their hits.
+    const std::shared_ptr<RouteCache>& GetRouteCache() const;
 private:
     std::unordered_map<StatRequestType, std::unordered_map<int, ProcessFn>> _processes;
     std::unique_ptr<IEventManager> m_evt_mgr;
+    std::shared_ptr<RouteCache> m_route_cache;
     static int _ct;
 };
 
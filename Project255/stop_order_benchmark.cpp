@@ -0,0 +1,253 @@
+#include "stop_order_benchmark.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "transport_catalogue.h"
+
+namespace {
+	constexpr uint64_t SEED = 20240u;
+	constexpr size_t STOPS_PER_BUS = 10u;
+	constexpr size_t ROUTE_SIZE = 40u;
+	constexpr size_t ROUTE_STATS_ROUNDS = 5u;
+	constexpr size_t QUERY_COUNT = 20000u;
+	constexpr size_t NEAREST_COUNT = 8u;
+
+	// Set-associative cache with LRU replacement; only the line addresses matter.
+	class CacheModel {
+	public:
+		void touch(const void* address) {
+			const uint64_t line = reinterpret_cast<uintptr_t>(address) / LINE_SIZE;
+			std::array<uint64_t, WAYS>& set = _sets[line % SETS];
+			auto it = std::find(set.begin(), set.end(), line + 1u);
+			if (it == set.end()) {
+				++_misses;
+				it = set.end() - 1;
+			}
+			// Most recently used first; 0 marks an empty way.
+			std::rotate(set.begin(), it, it + 1);
+			set.front() = line + 1u;
+			++_accesses;
+		}
+
+		uint64_t misses() const { return _misses; }
+		uint64_t accesses() const { return _accesses; }
+
+	private:
+		static constexpr size_t LINE_SIZE = 64u;
+		static constexpr size_t WAYS = 8u;
+		static constexpr size_t SETS = 32u * 1024u / LINE_SIZE / WAYS;
+
+		std::array<std::array<uint64_t, WAYS>, SETS> _sets{};
+		uint64_t _misses = 0;
+		uint64_t _accesses = 0;
+	};
+
+	// Stops sit on a jittered square grid about 150 m apart; routes wander between neighbouring cells.
+	struct SyntheticCity {
+		std::vector<std::string> stop_names;
+		std::vector<Coordinates> stop_coordinates;
+		std::vector<Distances> stop_distances;
+		std::vector<std::string> bus_names;
+		std::vector<std::vector<RouteStopName>> bus_stops;
+
+		std::vector<StopLoadData> stops() const {
+			std::vector<StopLoadData> res;
+			res.reserve(stop_names.size());
+			for (size_t i = 0; i < stop_names.size(); ++i) {
+				res.push_back({ stop_names[i], stop_coordinates[i], &stop_distances[i] });
+			}
+			return res;
+		}
+
+		std::vector<BusLoadData> buses() const {
+			std::vector<BusLoadData> res;
+			res.reserve(bus_names.size());
+			for (size_t i = 0; i < bus_names.size(); ++i) {
+				res.push_back({ bus_names[i], &bus_stops[i], i % 2u == 0u });
+			}
+			return res;
+		}
+	};
+
+	SyntheticCity MakeCity(size_t stop_count) {
+		constexpr double origin_lat = 55.6;
+		constexpr double origin_lng = 37.4;
+		constexpr double step_lat = 0.00135;
+		constexpr double step_lng = 0.0024;
+
+		std::mt19937_64 rng(SEED);
+		const size_t side = std::max<size_t>(2u, static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(stop_count)))));
+		std::uniform_real_distribution<double> jitter(-0.3, 0.3);
+
+		// Names are handed out in random order, the way stops come from base requests.
+		std::vector<size_t> name_of_cell(side * side);
+		std::iota(name_of_cell.begin(), name_of_cell.end(), size_t{ 0 });
+		std::shuffle(name_of_cell.begin(), name_of_cell.end(), rng);
+
+		SyntheticCity city;
+		city.stop_names.resize(side * side);
+		city.stop_coordinates.resize(side * side);
+		city.stop_distances.resize(side * side);
+		for (size_t cell = 0; cell < side * side; ++cell) {
+			const size_t name = name_of_cell[cell];
+			city.stop_names[name] = "Stop "s + std::to_string(name);
+			city.stop_coordinates[name] = {
+				origin_lat + (static_cast<double>(cell / side) + jitter(rng)) * step_lat,
+				origin_lng + (static_cast<double>(cell % side) + jitter(rng)) * step_lng
+			};
+		}
+
+		const size_t bus_count = std::max<size_t>(1u, side * side / STOPS_PER_BUS);
+		std::uniform_int_distribution<size_t> any_cell(0u, side * side - 1u);
+		std::uniform_int_distribution<int> any_step(0, 3);
+		std::uniform_int_distribution<int> road_detour(5, 40);
+		for (size_t bus = 0; bus < bus_count; ++bus) {
+			size_t cell = any_cell(rng);
+			std::vector<RouteStopName> stops;
+			stops.reserve(ROUTE_SIZE);
+			size_t prev = 0;
+			for (size_t i = 0; i < ROUTE_SIZE; ++i) {
+				const size_t name = name_of_cell[cell];
+				if (!stops.empty()) {
+					const double length = ComputeDistance(city.stop_coordinates[prev], city.stop_coordinates[name]);
+					city.stop_distances[prev][city.stop_names[name]] = static_cast<dist>(length * (100 + road_detour(rng)) / 100.0);
+				}
+				stops.push_back(city.stop_names[name]);
+				prev = name;
+				size_t row = cell / side;
+				size_t col = cell % side;
+				switch (any_step(rng)) {
+				case 0: row = row + 1u < side ? row + 1u : row - 1u; break;
+				case 1: row = row > 0u ? row - 1u : row + 1u; break;
+				case 2: col = col + 1u < side ? col + 1u : col - 1u; break;
+				default: col = col > 0u ? col - 1u : col + 1u; break;
+				}
+				cell = row * side + col;
+			}
+			city.bus_names.push_back(std::to_string(bus));
+			city.bus_stops.push_back(std::move(stops));
+		}
+		return city;
+	}
+
+	struct BenchmarkResult {
+		double finalize_ms = 0.0;
+		double route_stats_ms = 0.0;
+		double nearest_ms = 0.0;
+		double area_ms = 0.0;
+		double route_misses = 0.0; // simulated L1 misses per route stop visited
+		double area_misses = 0.0;  // simulated L1 misses per stop found in an area
+		double checksum = 0.0;
+	};
+
+	template<typename Fn>
+	double MeasureMs(Fn&& fn) {
+		const auto start = std::chrono::steady_clock::now();
+		fn();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	BenchmarkResult RunOrder(const SyntheticCity& city, StopOrder order) {
+		BenchmarkResult res;
+		TransportCatalogue tc;
+		tc.setStopOrder(order);
+		tc.Load(city.stops(), city.buses());
+		res.finalize_ms = MeasureMs([&] { tc.Finalize(); });
+
+		const size_t bus_count = city.bus_names.size();
+		res.route_stats_ms = MeasureMs([&] {
+			for (size_t round = 0; round < ROUTE_STATS_ROUNDS; ++round) {
+				for (BusIdx bus = 0; bus < bus_count; ++bus) {
+					res.checksum += tc.routeStats(bus).distance;
+				}
+			}
+		});
+
+		// Route traversal reads the longitude and latitude trigonometry of every stop it visits.
+		const CatalogueView& view = *tc.getAllRoutesInfoRef().layout;
+		CacheModel route_cache;
+		GeoBounds extent = GeoBounds::Empty();
+		for (BusIdx bus = 0; bus < bus_count; ++bus) {
+			for (StopIdx stop : tc.findRoute(bus).stops) {
+				extent.extend(view.stopLocation(stop));
+				route_cache.touch(view.stop_lng.data() + stop);
+				route_cache.touch(view.stop_sin_lat.data() + stop);
+				route_cache.touch(view.stop_cos_lat.data() + stop);
+			}
+		}
+		res.route_misses = static_cast<double>(route_cache.misses()) / static_cast<double>(route_cache.accesses() / 3u);
+
+		std::mt19937_64 rng(SEED + 1u);
+		std::uniform_real_distribution<double> any_lat(extent.min_lat, extent.max_lat);
+		std::uniform_real_distribution<double> any_lng(extent.min_lng, extent.max_lng);
+		std::vector<Coordinates> points(QUERY_COUNT);
+		for (Coordinates& point : points) {
+			point = { any_lat(rng), any_lng(rng) };
+		}
+
+		res.nearest_ms = MeasureMs([&] {
+			for (const Coordinates& point : points) {
+				for (const auto& [stop, distance] : tc.findNearestStops(point, NEAREST_COUNT)) {
+					res.checksum += distance;
+				}
+			}
+		});
+
+		// Boxes of about a kilometre square.
+		CacheModel area_cache;
+		size_t area_stops = 0;
+		res.area_ms = MeasureMs([&] {
+			for (const Coordinates& point : points) {
+				const GeoBounds area{ point.lat, point.lng, point.lat + 0.009, point.lng + 0.016 };
+				const std::vector<StopIdx> stops = tc.findStopsInArea(area);
+				area_stops += stops.size();
+				for (StopIdx stop : stops) {
+					area_cache.touch(view.stop_lat.data() + stop);
+					area_cache.touch(view.stop_lng.data() + stop);
+				}
+			}
+		});
+		res.area_misses = area_stops ? static_cast<double>(area_cache.misses()) / static_cast<double>(area_stops) : 0.0;
+		res.checksum += static_cast<double>(area_stops);
+		return res;
+	}
+}
+
+void RunStopOrderBenchmark(size_t stop_count, std::ostream& out) {
+	const SyntheticCity city = MakeCity(stop_count);
+	out << "stops: "s << city.stop_names.size() << ", buses: "s << city.bus_names.size()
+		<< ", stops per route: "s << ROUTE_SIZE << ", queries: "s << QUERY_COUNT << '\n';
+	out << std::left << std::setw(10) << "order"s << std::right
+		<< std::setw(13) << "finalize ms"s
+		<< std::setw(16) << "route stats ms"s
+		<< std::setw(12) << "nearest ms"s
+		<< std::setw(9) << "area ms"s
+		<< std::setw(22) << "L1 misses/route stop"s
+		<< std::setw(21) << "L1 misses/area stop"s << '\n';
+	const std::pair<StopOrder, std::string> orders[] = { { StopOrder::Insertion, "insertion"s }, { StopOrder::Hilbert, "hilbert"s } };
+	double checksum = 0.0;
+	for (const auto& [order, name] : orders) {
+		const BenchmarkResult res = RunOrder(city, order);
+		out << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(13) << res.finalize_ms
+			<< std::setw(16) << res.route_stats_ms
+			<< std::setw(12) << res.nearest_ms
+			<< std::setw(9) << res.area_ms
+			<< std::setw(22) << res.route_misses
+			<< std::setw(21) << res.area_misses << '\n';
+		if (checksum != 0.0 && std::abs(checksum - res.checksum) > 1e-6 * checksum) {
+			out << "results differ between stop orders\n"s;
+		}
+		checksum = res.checksum;
+	}
+	out.unsetf(std::ios::fixed);
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Read-only view of an interned string set laid out by StringPool: strings back to back in chars,
+// string id spanning [offsets[id], offsets[id + 1]), and an open-addressing index of ids in slots.
+// An erased string keeps its id and its slot, flagged with ERASED, so that find() skips it.
+// The layout does not depend on the owner, so the same view works over a StringPool or over the
+// sections of a mapped snapshot.
+struct StringPoolRef {
+	static constexpr uint32_t NPOS = ~uint32_t{ 0 };
+	static constexpr uint32_t ERASED = uint32_t{ 1 } << 31;
+
+	const char* chars;
+	const uint32_t* offsets;
+	const uint32_t* slots;
+	size_t count;
+	size_t capacity;
+
+	// FNV-1a; the index may be persisted, so the hash must not depend on the standard library.
+	static size_t Hash(std::string_view str) {
+		uint64_t hash = 14695981039346656037ULL;
+		for (char c : str) {
+			hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+		}
+		return static_cast<size_t>(hash);
+	}
+
+	size_t size() const { return count; }
+
+	std::string_view operator[](uint32_t id) const {
+		return { chars + offsets[id], static_cast<size_t>(offsets[id + 1u] - offsets[id]) };
+	}
+
+	uint32_t find(std::string_view str) const {
+		return find(str, Hash(str));
+	}
+
+	uint32_t find(std::string_view str, size_t hash) const {
+		if (capacity == 0u) {
+			return NPOS;
+		}
+		const size_t mask = capacity - 1u;
+		for (size_t idx = hash & mask;; idx = (idx + 1u) & mask) {
+			const uint32_t slot = slots[idx];
+			if (slot == NPOS || ((slot & ERASED) == 0u && (*this)[slot] == str)) {
+				return slot;
+			}
+		}
+	}
+
+	// Whether id names a string that has not been erased.
+	bool contains(uint32_t id) const {
+		return find((*this)[id]) == id;
+	}
+};
+
+// Interning pool that keeps all strings back to back in one contiguous character buffer.
+// Each string gets a dense 32-bit id in insertion order; lookup by string_view goes through an
+// open-addressing index of ids probed linearly, with the load factor kept at or below 1/2.
+// Views returned by operator[] and ref() stay valid until the next insert().
+// erase() only hides a string from lookups: ids stay dense, and inserting the string again brings
+// back its old id.
+class StringPool {
+public:
+	static constexpr uint32_t NPOS = StringPoolRef::NPOS;
+	static constexpr uint32_t ERASED = StringPoolRef::ERASED;
+
+	explicit StringPool(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+		: _chars(resource), _offsets(1u, 0u, resource), _slots(resource) {}
+
+	size_t size() const { return _offsets.size() - 1u; }
+	bool empty() const { return _offsets.size() == 1u; }
+	size_t chars() const { return _chars.size(); }
+
+	StringPoolRef ref() const {
+		return { _chars.data(), _offsets.data(), _slots.data(), size(), _slots.size() };
+	}
+
+	std::string_view operator[](uint32_t id) const {
+		return { _chars.data() + _offsets[id], static_cast<size_t>(_offsets[id + 1u] - _offsets[id]) };
+	}
+
+	void clear() {
+		_chars.clear();
+		_offsets.assign(1u, 0u);
+		_slots.clear();
+	}
+
+	// Replaces the contents with a copy of another pool, index and erased strings included.
+	void assign(const StringPoolRef& other) {
+		clear();
+		_chars.assign(other.chars, other.chars + other.offsets[other.count]);
+		_offsets.assign(other.offsets, other.offsets + other.count + 1u);
+		_slots.assign(other.slots, other.slots + other.capacity);
+	}
+
+	void reserve(size_t count, size_t chars) {
+		_chars.reserve(chars);
+		_offsets.reserve(count + 1u);
+		size_t capacity = MIN_CAPACITY;
+		while (capacity < count * 2u) {
+			capacity <<= 1;
+		}
+		if (capacity > _slots.size()) {
+			rehash(capacity);
+		}
+	}
+
+	static size_t Hash(std::string_view str) {
+		return StringPoolRef::Hash(str);
+	}
+
+	// Returns the id of str and whether it was added by this call.
+	std::pair<uint32_t, bool> insert(std::string_view str) {
+		return insert(str, Hash(str));
+	}
+
+	// Same as insert(str) with a hash precomputed by Hash(str), e.g. on another thread.
+	std::pair<uint32_t, bool> insert(std::string_view str, size_t hash) {
+		if ((size() + 1u) * 2u > _slots.size()) {
+			rehash(_slots.empty() ? MIN_CAPACITY : _slots.size() * 2u);
+		}
+		const size_t mask = _slots.size() - 1u;
+		for (size_t idx = hash & mask;; idx = (idx + 1u) & mask) {
+			uint32_t& slot = _slots[idx];
+			if (slot == NPOS) {
+				slot = static_cast<uint32_t>(size());
+				_chars.insert(_chars.end(), str.begin(), str.end());
+				_offsets.push_back(static_cast<uint32_t>(_chars.size()));
+				return { slot, true };
+			}
+			if ((*this)[slot & ~ERASED] == str) {
+				const bool revived = (slot & ERASED) != 0u;
+				slot &= ~ERASED;
+				return { slot, revived };
+			}
+		}
+	}
+
+	// Hides str from find(); returns its id, or NPOS if it is not in the pool.
+	uint32_t erase(std::string_view str) {
+		if (_slots.empty()) {
+			return NPOS;
+		}
+		const size_t mask = _slots.size() - 1u;
+		for (size_t idx = Hash(str) & mask;; idx = (idx + 1u) & mask) {
+			uint32_t& slot = _slots[idx];
+			if (slot == NPOS) {
+				return NPOS;
+			}
+			if ((*this)[slot & ~ERASED] == str) {
+				if ((slot & ERASED) != 0u) {
+					return NPOS;
+				}
+				slot |= ERASED;
+				return slot & ~ERASED;
+			}
+		}
+	}
+
+	uint32_t find(std::string_view str) const {
+		return ref().find(str);
+	}
+
+	uint32_t find(std::string_view str, size_t hash) const {
+		return ref().find(str, hash);
+	}
+
+private:
+	static constexpr size_t MIN_CAPACITY = 16u;
+
+	void rehash(size_t capacity) {
+		std::vector<bool> erased(size(), false);
+		for (uint32_t slot : _slots) {
+			if (slot != NPOS && (slot & ERASED) != 0u) {
+				erased[slot & ~ERASED] = true;
+			}
+		}
+		_slots.assign(capacity, NPOS);
+		const size_t mask = capacity - 1u;
+		for (uint32_t id = 0; id < size(); ++id) {
+			size_t idx = Hash((*this)[id]) & mask;
+			while (_slots[idx] != NPOS) {
+				idx = (idx + 1u) & mask;
+			}
+			_slots[idx] = erased[id] ? (id | ERASED) : id;
+		}
+	}
+
+	std::pmr::vector<char> _chars;
+	std::pmr::vector<uint32_t> _offsets;
+	std::pmr::vector<uint32_t> _slots;
+};
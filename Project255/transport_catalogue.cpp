@@ -1,187 +1,1434 @@
 #include "transport_catalogue.h"
+#include "bit_set.h"
+#include "catalogue_snapshot.h"
 
 #include <algorithm>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+
+TransportCatalogue::TransportCatalogue() : TransportCatalogue(nullptr) {
+}
+
+TransportCatalogue::TransportCatalogue(std::pmr::memory_resource* resource)
+	: _resource(resource ? resource : &_pool),
+	_stop_names(_resource),
+	_route_stops(_resource),
+	_bus_names(_resource),
+	_buses(_resource) {
+}
+
+std::pmr::memory_resource* TransportCatalogue::resource() const {
+	return _resource;
+}
+
+StopIdx TransportCatalogue::internStop(std::string_view name) {
+	return internStop(name, StringPool::Hash(name));
+}
+
+StopIdx TransportCatalogue::internStop(std::string_view name, size_t hash) {
+	// An erased stop that is inserted again gets its old id and row back.
+	const StopIdx stop = _stop_names.insert(name, hash).first;
+	if (stop == _route_stops.size()) {
+		_route_stops.push_back({ {0.0, 0.0}, std::pmr::vector<BusIdx>(_resource), std::pmr::vector<StopDistance>(_resource) });
+	}
+	return stop;
+}
+
+BusIdx TransportCatalogue::internBus(std::string_view bid) {
+	return internBus(bid, StringPool::Hash(bid));
+}
+
+BusIdx TransportCatalogue::internBus(std::string_view bid, size_t hash) {
+	const BusIdx bus = _bus_names.insert(bid, hash).first;
+	if (bus == _buses.size()) {
+		_buses.push_back({ std::pmr::vector<StopIdx>(_resource), false });
+	}
+	return bus;
+}
+
+StopIdx TransportCatalogue::stopIdx(std::string_view name) const {
+	uint32_t stop = stopNames().find(name);
+	if (stop == StringPool::NPOS) {
+		throw std::out_of_range("Unknown stop: "s + std::string(name));
+	}
+	return stop;
+}
+
+BusIdx TransportCatalogue::busIdx(std::string_view bid) const {
+	uint32_t bus = busNames().find(bid);
+	if (bus == StringPool::NPOS) {
+		throw std::out_of_range("Unknown bus: "s + std::string(bid));
+	}
+	return bus;
+}
+
+std::pmr::vector<StopDistance> TransportCatalogue::internDistances(const Distances& distances) {
+	std::pmr::vector<StopDistance> res(_resource);
+	res.reserve(distances.size());
+	for (const auto& [stop_name_to, distance] : distances) {
+		res.push_back({ internStop(stop_name_to), distance });
+	}
+	return res;
+}
 
 void TransportCatalogue::addRoute(BusID bus_num, Route route) {
-	std::for_each(route.stops.cbegin(), route.stops.cend(), [&](const std::string& name) { _route_stops[name].buses.insert(bus_num); });
-	_buses[bus_num] = std::move(route);
+	invalidate();
+	BusIdx bus = internBus(bus_num);
+	std::for_each(route.stops.cbegin(), route.stops.cend(), [&](StopIdx stop) { _route_stops[stop].buses.push_back(bus); });
+	_buses[bus] = std::move(route);
 }
 
 void TransportCatalogue::addRoute(BusID bus_num, std::vector<RouteStopName> stops) {
-	std::for_each(stops.cbegin(), stops.cend(), [&](const std::string& name) { _route_stops[name].buses.insert(bus_num); });
 	bool isCircle = stops[0] == stops[stops.size() - 1];
-	if (isCircle) {
-		_buses[bus_num] = Route{ {stops.begin(), stops.end() - 1}, isCircle };
+	addRoute(std::move(bus_num), std::move(stops), isCircle);
+}
+
+void TransportCatalogue::addRoute(BusID bus_num, std::vector<RouteStopName> stops, bool isCircle) {
+	invalidate();
+	BusIdx bus = internBus(bus_num);
+	Route route = internRoute(stops, isCircle);
+	for (StopIdx stop : route.stops) {
+		_route_stops[stop].buses.push_back(bus);
 	}
-	else {
-		_buses[bus_num] = Route{ std::move(stops), isCircle };
+	_buses[bus] = std::move(route);
+}
+
+Route TransportCatalogue::internRoute(const std::vector<RouteStopName>& stops, bool isCircle) {
+	Route route{ std::pmr::vector<StopIdx>(_resource), isCircle };
+	route.stops.reserve(stops.size());
+	for (const RouteStopName& name : stops) {
+		route.stops.push_back(internStop(name));
 	}
+	if (isCircle && !route.stops.empty() && route.stops[0] == route.stops[route.stops.size() - 1]) {
+		route.stops.pop_back();
+	}
+	return route;
 }
 
-void TransportCatalogue::addRoute(BusID bus_num, std::vector<RouteStopName> stops, bool isCircle) {
-	std::for_each(stops.cbegin(), stops.cend(), [&](const std::string& name) { _route_stops[name].buses.insert(bus_num); });
-	if (isCircle) {
-		if (stops[0] == stops[stops.size() - 1]) {
-			_buses[bus_num] = Route{ {stops.begin(), stops.end() - 1}, isCircle };
+void TransportCatalogue::Load(const std::vector<StopLoadData>& stops, const std::vector<BusLoadData>& buses) {
+	Load(std::execution::seq, stops, buses);
+}
+
+TransportCatalogue::LoadBatch TransportCatalogue::prepareLoad(const std::vector<StopLoadData>& stops, const std::vector<BusLoadData>& buses) {
+	invalidate();
+
+	LoadBatch batch;
+	batch.stops = &stops;
+	batch.buses = &buses;
+
+	const size_t items = stops.size() + buses.size();
+	const size_t chunk_count = std::max<size_t>(std::min(items, LOAD_CHUNK_COUNT), 1u);
+	batch.chunk_offsets.reserve(chunk_count + 1);
+	for (size_t chunk = 0; chunk <= chunk_count; ++chunk) {
+		batch.chunk_offsets.push_back(chunk * items / chunk_count);
+	}
+	batch.name_hashes.resize(items);
+	batch.missing_stops.resize(chunk_count);
+
+	batch.distance_offsets.reserve(stops.size() + 1);
+	batch.distance_offsets.push_back(0);
+	for (const StopLoadData& stop : stops) {
+		batch.distance_offsets.push_back(batch.distance_offsets.back() + stop.distances->size());
+	}
+	batch.distances.resize(batch.distance_offsets.back());
+
+	batch.route_offsets.reserve(buses.size() + 1);
+	batch.route_offsets.push_back(0);
+	for (const BusLoadData& bus : buses) {
+		batch.route_offsets.push_back(batch.route_offsets.back() + bus.stops->size());
+	}
+	batch.route_sizes.resize(buses.size());
+	batch.route_stops.resize(batch.route_offsets.back());
+	return batch;
+}
+
+void TransportCatalogue::hashLoadChunk(LoadBatch& batch, size_t chunk) const {
+	const size_t stop_count = batch.stops->size();
+	for (size_t item = batch.chunk_offsets[chunk]; item < batch.chunk_offsets[chunk + 1]; ++item) {
+		std::string_view name = item < stop_count ? (*batch.stops)[item].name : (*batch.buses)[item - stop_count].name;
+		batch.name_hashes[item] = StringPool::Hash(name);
+	}
+}
+
+void TransportCatalogue::declareLoad(LoadBatch& batch) {
+	const std::vector<StopLoadData>& stops = *batch.stops;
+	const std::vector<BusLoadData>& buses = *batch.buses;
+
+	size_t stop_chars = 0;
+	for (const StopLoadData& stop : stops) {
+		stop_chars += stop.name.size();
+	}
+	size_t bus_chars = 0;
+	for (const BusLoadData& bus : buses) {
+		bus_chars += bus.name.size();
+	}
+	_stop_names.reserve(_stop_names.size() + stops.size(), _stop_names.chars() + stop_chars);
+	_route_stops.reserve(_route_stops.size() + stops.size());
+	_bus_names.reserve(_bus_names.size() + buses.size(), _bus_names.chars() + bus_chars);
+	_buses.reserve(_buses.size() + buses.size());
+
+	// Every declared stop and bus gets its id before any reference is resolved, so the later passes
+	// only look names up.
+	batch.stop_ids.reserve(stops.size());
+	for (size_t i = 0; i < stops.size(); ++i) {
+		batch.stop_ids.push_back(internStop(stops[i].name, batch.name_hashes[i]));
+	}
+	batch.bus_ids.reserve(buses.size());
+	for (size_t i = 0; i < buses.size(); ++i) {
+		batch.bus_ids.push_back(internBus(buses[i].name, batch.name_hashes[stops.size() + i]));
+	}
+}
+
+void TransportCatalogue::scanLoadChunk(LoadBatch& batch, size_t chunk) const {
+	std::vector<std::string_view>& missing = batch.missing_stops[chunk];
+	std::unordered_set<std::string_view> seen;
+	auto check = [&](std::string_view name) {
+		if (_stop_names.find(name) == StringPool::NPOS && seen.insert(name).second) {
+			missing.push_back(name);
+		}
+	};
+
+	const size_t stop_count = batch.stops->size();
+	for (size_t item = batch.chunk_offsets[chunk]; item < batch.chunk_offsets[chunk + 1]; ++item) {
+		if (item < stop_count) {
+			for (const auto& [stop_name_to, distance] : *(*batch.stops)[item].distances) {
+				check(stop_name_to);
+			}
 		}
 		else {
-			_buses[bus_num] = Route{ std::move(stops), isCircle };
+			for (const RouteStopName& name : *(*batch.buses)[item - stop_count].stops) {
+				check(name);
+			}
 		}
 	}
-	else {
-		_buses[bus_num] = Route{ std::move(stops), isCircle };
+}
+
+void TransportCatalogue::internMissingStops(LoadBatch& batch) {
+	// Stops that are referenced but never declared are interned like addRoute() does, in the order
+	// a sequential scan would meet them.
+	size_t count = 0;
+	size_t chars = 0;
+	for (const std::vector<std::string_view>& missing : batch.missing_stops) {
+		count += missing.size();
+		for (std::string_view name : missing) {
+			chars += name.size();
+		}
+	}
+	_stop_names.reserve(_stop_names.size() + count, _stop_names.chars() + chars);
+	_route_stops.reserve(_route_stops.size() + count);
+	for (const std::vector<std::string_view>& missing : batch.missing_stops) {
+		for (std::string_view name : missing) {
+			internStop(name);
+		}
+	}
+}
+
+void TransportCatalogue::resolveLoadChunk(LoadBatch& batch, size_t chunk) const {
+	const size_t stop_count = batch.stops->size();
+	for (size_t item = batch.chunk_offsets[chunk]; item < batch.chunk_offsets[chunk + 1]; ++item) {
+		if (item < stop_count) {
+			StopDistance* out = batch.distances.data() + batch.distance_offsets[item];
+			for (const auto& [stop_name_to, distance] : *(*batch.stops)[item].distances) {
+				*out++ = { _stop_names.find(stop_name_to), distance };
+			}
+		}
+		else {
+			const size_t bus = item - stop_count;
+			const BusLoadData& data = (*batch.buses)[bus];
+			StopIdx* begin = batch.route_stops.data() + batch.route_offsets[bus];
+			StopIdx* out = begin;
+			for (const RouteStopName& name : *data.stops) {
+				*out++ = _stop_names.find(name);
+			}
+			if (data.is_circle && out != begin && *begin == *(out - 1)) {
+				--out;
+			}
+			batch.route_sizes[bus] = static_cast<size_t>(out - begin);
+		}
 	}
 }
 
-void TransportCatalogue::addRouteStop(const std::string& stop_name, Coordinates coords, Distances distances) {
-	if (_route_stops.count(stop_name)) {
-		LocalBuses& lb = _route_stops.at(stop_name);
-		lb.location = coords;
-		lb.distances = distances;
+void TransportCatalogue::commitLoad(LoadBatch& batch) {
+	const std::vector<StopLoadData>& stops = *batch.stops;
+	const std::vector<BusLoadData>& buses = *batch.buses;
+
+	for (size_t i = 0; i < stops.size(); ++i) {
+		LocalBuses& lb = _route_stops[batch.stop_ids[i]];
+		lb.location = stops[i].coordinates;
+		lb.distances.assign(batch.distances.cbegin() + batch.distance_offsets[i], batch.distances.cbegin() + batch.distance_offsets[i + 1]);
 	}
-	else {
-		_route_stops[stop_name] = { coords, {}, distances };
+	for (size_t i = 0; i < buses.size(); ++i) {
+		Route& route = _buses[batch.bus_ids[i]];
+		auto route_begin = batch.route_stops.cbegin() + batch.route_offsets[i];
+		route.stops.assign(route_begin, route_begin + batch.route_sizes[i]);
+		route.isRouteCircle = buses[i].is_circle;
+	}
+
+	std::vector<uint32_t> bus_counts(_route_stops.size(), 0u);
+	for (BusIdx bus : batch.bus_ids) {
+		for (StopIdx stop : _buses[bus].stops) {
+			++bus_counts[stop];
+		}
+	}
+	for (StopIdx stop = 0; stop < _route_stops.size(); ++stop) {
+		_route_stops[stop].buses.reserve(_route_stops[stop].buses.size() + bus_counts[stop]);
+	}
+	for (BusIdx bus : batch.bus_ids) {
+		for (StopIdx stop : _buses[bus].stops) {
+			_route_stops[stop].buses.push_back(bus);
+		}
 	}
 }
 
-void TransportCatalogue::setDistances(const std::string& stop_name, Distances distances) {
-	if (_route_stops.count(stop_name)) {
-		_route_stops.at(stop_name).distances = distances;
+void TransportCatalogue::addRouteStop(std::string_view stop_name, Coordinates coords, Distances distances) {
+	invalidate();
+	StopIdx stop = internStop(stop_name);
+	std::pmr::vector<StopDistance> stop_distances = internDistances(distances);
+	LocalBuses& lb = _route_stops[stop];
+	lb.location = coords;
+	lb.distances = std::move(stop_distances);
+}
+
+void TransportCatalogue::setDistances(std::string_view stop_name, Distances distances) {
+	invalidate();
+	StopIdx stop = internStop(stop_name);
+	std::pmr::vector<StopDistance> stop_distances = internDistances(distances);
+	_route_stops[stop].distances = std::move(stop_distances);
+}
+
+void TransportCatalogue::setDistance(std::string_view stop_name_from, std::string_view stop_name_to, dist distance) {
+	invalidate();
+	StopIdx from = internStop(stop_name_from);
+	StopIdx to = internStop(stop_name_to);
+	std::pmr::vector<StopDistance>& distances = _route_stops[from].distances;
+	auto it = std::find_if(distances.begin(), distances.end(), [to](const StopDistance& sd) { return sd.first == to; });
+	if (it == distances.end()) {
+		distances.push_back({ to, distance });
 	}
-	else {
-		_route_stops[stop_name] = { {0.0, 0.0}, {}, distances };
+}
+
+void TransportCatalogue::updateRoute(std::string_view bid, const std::vector<RouteStopName>& stops, bool isCircle) {
+	checkWritable();
+	LayoutUpdate update;
+	const BusIdx bus = internBus(bid);
+	Route route = internRoute(stops, isCircle);
+	detachRoute(bus, update);
+	for (StopIdx stop : route.stops) {
+		_route_stops[stop].buses.push_back(bus);
+		update.served_stops.push_back(stop);
 	}
+	_buses[bus] = std::move(route);
+	updateLayout(update);
+}
+
+void TransportCatalogue::removeRoute(std::string_view bid) {
+	checkWritable();
+	LayoutUpdate update;
+	const BusIdx bus = busIdx(bid);
+	detachRoute(bus, update);
+	_buses[bus].isRouteCircle = false;
+	_bus_names.erase(bid);
+	updateLayout(update);
 }
 
-void TransportCatalogue::setDistance(const std::string& stop_name_from, const std::string& stop_name_to, dist distance) {
-	if (_route_stops.count(stop_name_from)) {
-		_route_stops.at(stop_name_from).distances.insert({ stop_name_to, distance });
+void TransportCatalogue::updateRouteStop(std::string_view stop_name, Coordinates coords, const Distances& distances) {
+	checkWritable();
+	LayoutUpdate update;
+	const StopIdx stop = internStop(stop_name);
+	std::pmr::vector<StopDistance> stop_distances = internDistances(distances);
+	_route_stops[stop].location = coords;
+	update.moved_stops.push_back(stop);
+	setStopDistances(stop, std::move(stop_distances), update);
+	updateLayout(update);
+}
+
+void TransportCatalogue::removeRouteStop(std::string_view stop_name) {
+	checkWritable();
+	const StopIdx stop = stopIdx(stop_name);
+	if (!_route_stops[stop].buses.empty()) {
+		throw std::logic_error("Stop is still served by a bus: "s + std::string(stop_name));
+	}
+	// Distances declared by other stops towards this one are kept: they come back with the stop.
+	LayoutUpdate update;
+	_route_stops[stop].location = { 0.0, 0.0 };
+	update.moved_stops.push_back(stop);
+	setStopDistances(stop, std::pmr::vector<StopDistance>(_resource), update);
+	_stop_names.erase(stop_name);
+	updateLayout(update);
+}
+
+void TransportCatalogue::updateDistance(std::string_view stop_name_from, std::string_view stop_name_to, dist distance) {
+	checkWritable();
+	LayoutUpdate update;
+	const StopIdx from = internStop(stop_name_from);
+	const StopIdx to = internStop(stop_name_to);
+	std::pmr::vector<StopDistance>& distances = _route_stops[from].distances;
+	auto it = std::find_if(distances.begin(), distances.end(), [to](const StopDistance& sd) { return sd.first == to; });
+	if (it == distances.end()) {
+		distances.push_back({ to, distance });
 	}
 	else {
-		Distances d;
-		d.insert({ stop_name_to, distance });
-		_route_stops[stop_name_from] = { {0.0, 0.0}, {}, std::move(d) };
+		it->second = distance;
+	}
+	update.distances.push_back({ from, to });
+	updateLayout(update);
+}
+
+void TransportCatalogue::detachRoute(BusIdx bus, LayoutUpdate& update) {
+	Route& route = _buses[bus];
+	for (StopIdx stop : route.stops) {
+		std::pmr::vector<BusIdx>& buses = _route_stops[stop].buses;
+		buses.erase(std::remove(buses.begin(), buses.end(), bus), buses.end());
+		update.served_stops.push_back(stop);
 	}
+	route.stops.clear();
+	update.buses.push_back(bus);
 }
 
-dist TransportCatalogue::getFromDistance(const std::string& stop_name_from, const std::string& stop_name_to) const {
-	if (_route_stops.count(stop_name_from) && _route_stops.at(stop_name_from).distances.count(stop_name_to)) {
-		return _route_stops.at(stop_name_from).distances.at(stop_name_to);
+void TransportCatalogue::setStopDistances(StopIdx stop, std::pmr::vector<StopDistance> distances, LayoutUpdate& update) {
+	for (const auto& [to, distance] : _route_stops[stop].distances) {
+		update.distances.push_back({ stop, to });
+	}
+	for (const auto& [to, distance] : distances) {
+		update.distances.push_back({ stop, to });
+	}
+	_route_stops[stop].distances = std::move(distances);
+}
+
+dist TransportCatalogue::getFromDistance(std::string_view stop_name_from, std::string_view stop_name_to) const {
+	std::optional<StopIdx> from = findStopIdx(stop_name_from);
+	std::optional<StopIdx> to = findStopIdx(stop_name_to);
+	if (from && to) {
+		return getFromDistance(*from, *to);
 	}
 	return 0;
 }
 
-double TransportCatalogue::getLength(const std::string& stop_name_from, const std::string& stop_name_to) const {
-	if (_route_stops.count(stop_name_from) && _route_stops.count(stop_name_to)) {
-		return ComputeDistance(_route_stops.at(stop_name_from).location, _route_stops.at(stop_name_to).location);
+double TransportCatalogue::getLength(std::string_view stop_name_from, std::string_view stop_name_to) const {
+	std::optional<StopIdx> from = findStopIdx(stop_name_from);
+	std::optional<StopIdx> to = findStopIdx(stop_name_to);
+	if (from && to) {
+		return getLength(*from, *to);
 	}
 	return 0.0;
 }
 
-double TransportCatalogue::getFromDistanceOrLength(const std::string& stop_name_from, const std::string& stop_name_to) const {
-	if (_route_stops.count(stop_name_from)) {
-		if (_route_stops.at(stop_name_from).distances.count(stop_name_to)) {
-			return _route_stops.at(stop_name_from).distances.at(stop_name_to);
+double TransportCatalogue::getFromDistanceOrLength(std::string_view stop_name_from, std::string_view stop_name_to) const {
+	std::optional<StopIdx> from = findStopIdx(stop_name_from);
+	std::optional<StopIdx> to = findStopIdx(stop_name_to);
+	if (from && to) {
+		return getFromDistanceOrLength(*from, *to);
+	}
+	return 0.0;
+}
+
+dist TransportCatalogue::getFromDistance(StopIdx from, StopIdx to) const {
+	const RoadDistance* rd = layout().roadDistance(from, to);
+	if (rd && !rd->is_reverse) {
+		return rd->distance;
+	}
+	return 0;
+}
+
+double TransportCatalogue::getLength(StopIdx from, StopIdx to) const {
+	return ComputeDistance(geoPoints(), from, to);
+}
+
+double TransportCatalogue::getFromDistanceOrLength(StopIdx from, StopIdx to) const {
+	const RoadDistance* rd = layout().roadDistance(from, to);
+	if (rd) {
+		return rd->distance;
+	}
+	return ComputeDistance(geoPoints(), from, to);
+}
+
+void TransportCatalogue::Finalize() {
+	Finalize(std::execution::seq);
+}
+
+void TransportCatalogue::setStopOrder(StopOrder order) {
+	_stop_order = order;
+}
+
+StopOrder TransportCatalogue::stopOrder() const {
+	return _stop_order;
+}
+
+void TransportCatalogue::renumberStops() {
+	const StringPoolRef names = _stop_names.ref();
+	GeoBounds extent = GeoBounds::Empty();
+	for (StopIdx stop = 0; stop < _route_stops.size(); ++stop) {
+		if (names.contains(stop)) {
+			extent.extend(_route_stops[stop].location);
+		}
+	}
+
+	// Erased stops keep their rows, after every live one.
+	std::vector<std::pair<uint64_t, StopIdx>> keys;
+	keys.reserve(_route_stops.size());
+	for (StopIdx stop = 0; stop < _route_stops.size(); ++stop) {
+		const uint64_t key = names.contains(stop) ? ComputeHilbertIndex(_route_stops[stop].location, extent) : std::numeric_limits<uint64_t>::max();
+		keys.push_back({ key, stop });
+	}
+	std::sort(keys.begin(), keys.end());
+	bool unchanged = true;
+	for (StopIdx stop = 0; stop < keys.size(); ++stop) {
+		unchanged = unchanged && keys[stop].second == stop;
+	}
+	if (unchanged) {
+		return;
+	}
+
+	std::vector<StopIdx> new_idx(keys.size());
+	StringPool stop_names(_resource);
+	RouteStops route_stops(_resource);
+	stop_names.reserve(keys.size(), _stop_names.chars());
+	route_stops.reserve(keys.size());
+	for (StopIdx stop = 0; stop < keys.size(); ++stop) {
+		const StopIdx old = keys[stop].second;
+		new_idx[old] = stop;
+		stop_names.insert(_stop_names[old]);
+		route_stops.push_back(std::move(_route_stops[old]));
+	}
+	for (StopIdx stop = 0; stop < keys.size(); ++stop) {
+		if (!names.contains(keys[stop].second)) {
+			stop_names.erase(stop_names[stop]);
+		}
+	}
+	for (LocalBuses& lb : route_stops) {
+		for (StopDistance& distance : lb.distances) {
+			distance.first = new_idx[distance.first];
+		}
+	}
+	for (Route& route : _buses) {
+		for (StopIdx& stop : route.stops) {
+			stop = new_idx[stop];
+		}
+	}
+	_stop_names = std::move(stop_names);
+	_route_stops = std::move(route_stops);
+}
+
+void TransportCatalogue::compileLayout() {
+	invalidate();
+	if (_stop_order == StopOrder::Hilbert) {
+		renumberStops();
+	}
+	CatalogueLayout res;
+	compileRoutes(res);
+
+	size_t stop_buses_count = 0;
+	size_t stop_distances_count = 0;
+	for (const LocalBuses& lb : _route_stops) {
+		stop_buses_count += lb.buses.size();
+		stop_distances_count += lb.distances.size();
+	}
+	res.stop_bus_offsets.reserve(_route_stops.size() + 1);
+	res.stop_buses.reserve(stop_buses_count);
+	res.road_distances.reserve(stop_distances_count * 2);
+	res.stop_lat.reserve(_route_stops.size());
+	res.stop_lng.reserve(_route_stops.size());
+	res.stop_bus_offsets.push_back(0);
+	for (const LocalBuses& lb : _route_stops) {
+		appendStopBuses(res.stop_buses, lb);
+		res.stop_bus_offsets.push_back(static_cast<uint32_t>(res.stop_buses.size()));
+
+		res.stop_lat.push_back(lb.location.lat);
+		res.stop_lng.push_back(lb.location.lng);
+	}
+	res.stop_sin_lat.resize(res.stop_lat.size());
+	res.stop_cos_lat.resize(res.stop_lat.size());
+	ComputeLatitudeTrigonometry(res.stop_lat.data(), res.stop_lat.size(), res.stop_sin_lat.data(), res.stop_cos_lat.data());
+
+	for (StopIdx from = 0; from < _route_stops.size(); ++from) {
+		for (const auto& [to, distance] : _route_stops[from].distances) {
+			res.road_distances.insert_or_assign(from, to, { distance, false });
+		}
+	}
+	for (StopIdx from = 0; from < _route_stops.size(); ++from) {
+		for (const auto& [to, distance] : _route_stops[from].distances) {
+			res.road_distances.insert(to, from, { distance, true });
+		}
+	}
+
+	res.route_stats.resize(res.route_circle.size());
+	res.stop_bounds = fitStopBounds(res);
+	compileStopGrid(res);
+	compileTransferIndex(res);
+
+	_layout = std::move(res);
+	_view = _layout.view();
+	_finalized = true;
+	advanceGeneration();
+}
+
+void TransportCatalogue::compileRoutes(CatalogueLayout& res) const {
+	size_t route_stops_count = 0;
+	for (const Route& route : _buses) {
+		route_stops_count += route.stops.size();
+	}
+	res.route_offsets.clear();
+	res.route_stops.clear();
+	res.route_circle.clear();
+	res.route_sum_offsets.clear();
+	res.route_offsets.reserve(_buses.size() + 1);
+	res.route_stops.reserve(route_stops_count);
+	res.route_circle.reserve(_buses.size());
+	res.route_sum_offsets.reserve(_buses.size() + 1);
+	res.route_offsets.push_back(0);
+	res.route_sum_offsets.push_back(0);
+	for (const Route& route : _buses) {
+		res.route_stops.insert(res.route_stops.end(), route.stops.cbegin(), route.stops.cend());
+		res.route_offsets.push_back(static_cast<uint32_t>(res.route_stops.size()));
+		res.route_circle.push_back(route.isRouteCircle ? 1 : 0);
+		const size_t positions = route.stops.empty() ? 0u : RideSegmentCount({ route.stops, route.isRouteCircle }) + 1u;
+		res.route_sum_offsets.push_back(res.route_sum_offsets.back() + static_cast<uint32_t>(positions));
+	}
+	// Filled bus by bus by compileRouteSums() once the distances are in place.
+	res.route_distance_sums.resize(res.route_sum_offsets.back());
+	res.route_length_sums.resize(res.route_sum_offsets.back());
+}
+
+void TransportCatalogue::compileRouteSums(BusIdx bus) {
+	const CatalogueView& l = layout();
+	RouteRef rt = l.route(bus);
+	if (rt.stops.empty()) {
+		return;
+	}
+	double* distance_sums = _layout.route_distance_sums.data() + _layout.route_sum_offsets[bus];
+	double* length_sums = _layout.route_length_sums.data() + _layout.route_sum_offsets[bus];
+
+	thread_local std::vector<double> segment_lengths;
+	segment_lengths.resize(rt.stops.size());
+	GeoPointsRef points = geoPoints();
+	ComputeSegmentDistances(points, rt.stops.data(), rt.stops.size(), segment_lengths.data());
+	if (rt.isRouteCircle) {
+		segment_lengths.back() = ComputeDistance(points, rt.stops.back(), rt.stops.front());
+	}
+
+	size_t position = 0;
+	distance_sums[0] = 0.0;
+	length_sums[0] = 0.0;
+	auto ride = [&](StopIdx from, StopIdx to, double length) {
+		const RoadDistance* road = l.roadDistance(from, to);
+		distance_sums[position + 1] = distance_sums[position] + (road ? road->distance : length);
+		length_sums[position + 1] = length_sums[position] + length;
+		++position;
+	};
+	size_t segment = 0;
+	forEachRouteSegment(rt, [&](StopIdx from, StopIdx to) { ride(from, to, segment_lengths[segment++]); });
+	if (!rt.isRouteCircle) {
+		for (size_t i = rt.stops.size() - 1; i > 0; --i) {
+			ride(rt.stops[i], rt.stops[i - 1], segment_lengths[i - 1]);
+		}
+	}
+}
+
+void TransportCatalogue::appendStopBuses(std::vector<BusIdx>& stop_buses, const LocalBuses& lb) const {
+	auto buses_begin = stop_buses.insert(stop_buses.end(), lb.buses.cbegin(), lb.buses.cend());
+	std::sort(buses_begin, stop_buses.end(), [&](BusIdx lhs, BusIdx rhs) { return _bus_names[lhs] < _bus_names[rhs]; });
+	stop_buses.erase(std::unique(buses_begin, stop_buses.end()), stop_buses.end());
+}
+
+GeoBounds TransportCatalogue::fitStopBounds(const CatalogueLayout& res) const {
+	GeoBounds bounds = GeoBounds::Empty();
+	for (StopIdx stop = 0; stop < res.stop_lat.size(); ++stop) {
+		if (res.stop_bus_offsets[stop + 1] != res.stop_bus_offsets[stop]) {
+			bounds.extend({ res.stop_lat[stop], res.stop_lng[stop] });
+		}
+	}
+	return bounds;
+}
+
+void TransportCatalogue::compileTransferIndex(CatalogueLayout& res) const {
+	const size_t stop_count = res.stop_lat.size();
+	const size_t words = BitSetWords(res.route_circle.size());
+	res.stop_bus_bits.assign(stop_count * words, 0u);
+
+	// Every stop of every pair of buses calling at it; sorted, each pair gets a run of ascending stops.
+	std::vector<std::pair<uint64_t, StopIdx>> incidences;
+	for (StopIdx stop = 0; stop < stop_count; ++stop) {
+		const BusIdx* begin = res.stop_buses.data() + res.stop_bus_offsets[stop];
+		const BusIdx* end = res.stop_buses.data() + res.stop_bus_offsets[stop + 1];
+		for (const BusIdx* first = begin; first != end; ++first) {
+			SetBit(res.stop_bus_bits.data() + stop * words, *first);
+			for (const BusIdx* second = begin; second != end; ++second) {
+				if (*first <= *second) {
+					incidences.push_back({ TransferTable::MakeKey(*first, *second), stop });
+				}
+			}
+		}
+	}
+	std::sort(incidences.begin(), incidences.end());
+
+	size_t pair_count = 0;
+	for (size_t i = 0; i < incidences.size(); ++i) {
+		if (i == 0 || incidences[i].first != incidences[i - 1].first) {
+			++pair_count;
+		}
+	}
+	res.transfers.clear();
+	res.transfers.reserve(pair_count);
+	res.transfer_stops.clear();
+	res.transfer_stops.reserve(incidences.size());
+	for (size_t i = 0; i < incidences.size();) {
+		const uint64_t key = incidences[i].first;
+		const uint32_t offset = static_cast<uint32_t>(res.transfer_stops.size());
+		for (; i < incidences.size() && incidences[i].first == key; ++i) {
+			res.transfer_stops.push_back(incidences[i].second);
+		}
+		res.transfers.insert(static_cast<uint32_t>(key >> 32), static_cast<uint32_t>(key), { offset, static_cast<uint32_t>(res.transfer_stops.size()) - offset });
+	}
+}
+
+void TransportCatalogue::compileStopGrid(CatalogueLayout& res) const {
+	std::vector<StopIdx> stops;
+	stops.reserve(res.stop_lat.size());
+	GeoBounds extent = GeoBounds::Empty();
+	for (StopIdx stop = 0; stop < res.stop_lat.size(); ++stop) {
+		if (_stop_names.ref().contains(stop)) {
+			stops.push_back(stop);
+			extent.extend({ res.stop_lat[stop], res.stop_lng[stop] });
+		}
+	}
+	if (stops.empty()) {
+		extent = { 0.0, 0.0, 0.0, 0.0 };
+	}
+
+	// Cells are roughly square on the ground, about GRID_STOPS_PER_CELL stops each on average.
+	const double lat_span = extent.max_lat - extent.min_lat;
+	const double lng_span = (extent.max_lng - extent.min_lng) * std::cos((extent.min_lat + extent.max_lat) / 2.0 * 3.14159265358979323846 / 180.0);
+	const double cells = std::max<double>(1.0, std::ceil(static_cast<double>(stops.size()) / GRID_STOPS_PER_CELL));
+	double side = std::sqrt(lat_span * lng_span / cells);
+	if (side == 0.0) {
+		side = std::max(lat_span, lng_span) / cells;
+	}
+	auto divisions = [&](double span) {
+		return side > 0.0 ? static_cast<uint32_t>(std::clamp(std::ceil(span / side), 1.0, cells)) : 1u;
+	};
+	StopGrid& grid = res.stop_grid;
+	grid.rows = divisions(lat_span);
+	grid.cols = divisions(lng_span);
+	grid.min_lat = extent.min_lat;
+	grid.min_lng = extent.min_lng;
+	grid.cell_lat = lat_span > 0.0 ? lat_span / grid.rows : 1.0;
+	grid.cell_lng = extent.max_lng > extent.min_lng ? (extent.max_lng - extent.min_lng) / grid.cols : 1.0;
+
+	// Counting sort of the stops by cell.
+	std::vector<uint32_t> stop_cells(stops.size());
+	res.grid_cell_offsets.assign(size_t{ grid.rows } * grid.cols + 1, 0u);
+	for (size_t i = 0; i < stops.size(); ++i) {
+		stop_cells[i] = grid.cell(grid.row(res.stop_lat[stops[i]]), grid.col(res.stop_lng[stops[i]]));
+		++res.grid_cell_offsets[stop_cells[i] + 1];
+	}
+	std::partial_sum(res.grid_cell_offsets.cbegin(), res.grid_cell_offsets.cend(), res.grid_cell_offsets.begin());
+	res.grid_stops.resize(stops.size());
+	std::vector<uint32_t> fill(res.grid_cell_offsets.cbegin(), res.grid_cell_offsets.cend() - 1);
+	for (size_t i = 0; i < stops.size(); ++i) {
+		res.grid_stops[fill[stop_cells[i]]++] = stops[i];
+	}
+}
+
+void TransportCatalogue::refreshRoadDistance(StopIdx from, StopIdx to) {
+	// Both directions are resolved again from the declarations, the way compileLayout() fills them.
+	auto declared = [this](StopIdx from, StopIdx to) -> const dist* {
+		const std::pmr::vector<StopDistance>& distances = _route_stops[from].distances;
+		auto it = std::find_if(distances.cbegin(), distances.cend(), [to](const StopDistance& sd) { return sd.first == to; });
+		return it == distances.cend() ? nullptr : &it->second;
+	};
+	auto refresh = [&](StopIdx from, StopIdx to) {
+		if (const dist* forward = declared(from, to)) {
+			_layout.road_distances.insert_or_assign(from, to, { *forward, false });
+		}
+		else if (const dist* backward = declared(to, from)) {
+			_layout.road_distances.insert_or_assign(from, to, { *backward, true });
 		}
 		else {
-			if (_route_stops.at(stop_name_to).distances.count(stop_name_from)) {
-				return _route_stops.at(stop_name_to).distances.at(stop_name_from);
+			_layout.road_distances.erase(from, to);
+		}
+	};
+	refresh(from, to);
+	if (from != to) {
+		refresh(to, from);
+	}
+}
+
+void TransportCatalogue::updateLayout(const LayoutUpdate& update) {
+	if (!_finalized) {
+		return;
+	}
+	CatalogueLayout& l = _layout;
+	const size_t old_stop_count = l.stop_lat.size();
+	const size_t stop_count = _route_stops.size();
+	auto is_served = [&l](StopIdx stop) { return l.stop_bus_offsets[stop + 1] != l.stop_bus_offsets[stop]; };
+
+	// The bounds are extended in place unless a served stop on the border moves or loses its buses,
+	// which needs one pass over all stops.
+	bool refit_bounds = false;
+	auto check_border = [&](StopIdx stop) {
+		if (stop < old_stop_count && is_served(stop) && l.stop_bounds.touches({ l.stop_lat[stop], l.stop_lng[stop] })) {
+			refit_bounds = true;
+		}
+	};
+	std::for_each(update.served_stops.cbegin(), update.served_stops.cend(), check_border);
+	std::for_each(update.moved_stops.cbegin(), update.moved_stops.cend(), check_border);
+
+	// A route keeping its length and shape is overwritten in place; anything else recompiles the route
+	// rows, and with them the offsets of every route's distance sums.
+	bool recompile_routes = _buses.size() != l.route_circle.size();
+	for (auto it = update.buses.cbegin(); !recompile_routes && it != update.buses.cend(); ++it) {
+		const Route& route = _buses[*it];
+		if (l.route_offsets[*it + 1] - l.route_offsets[*it] != route.stops.size() || (l.route_circle[*it] != 0) != route.isRouteCircle) {
+			recompile_routes = true;
+			break;
+		}
+		std::copy(route.stops.cbegin(), route.stops.cend(), l.route_stops.begin() + l.route_offsets[*it]);
+		l.route_circle[*it] = route.isRouteCircle ? 1 : 0;
+	}
+	if (recompile_routes) {
+		compileRoutes(l);
+	}
+
+	l.stop_lat.resize(stop_count);
+	l.stop_lng.resize(stop_count);
+	l.stop_sin_lat.resize(stop_count);
+	l.stop_cos_lat.resize(stop_count);
+	auto place = [&](StopIdx stop) {
+		l.stop_lat[stop] = _route_stops[stop].location.lat;
+		l.stop_lng[stop] = _route_stops[stop].location.lng;
+		ComputeLatitudeTrigonometry(&l.stop_lat[stop], 1u, &l.stop_sin_lat[stop], &l.stop_cos_lat[stop]);
+	};
+	for (StopIdx stop = static_cast<StopIdx>(old_stop_count); stop < stop_count; ++stop) {
+		place(stop);
+	}
+	std::for_each(update.moved_stops.cbegin(), update.moved_stops.cend(), place);
+
+	// Rows of untouched stops are copied over; only the touched ones are sorted again.
+	if (!update.served_stops.empty() || stop_count != old_stop_count) {
+		std::vector<uint8_t> touched(stop_count, 0u);
+		std::fill(touched.begin() + old_stop_count, touched.end(), uint8_t{ 1 });
+		for (StopIdx stop : update.served_stops) {
+			touched[stop] = 1u;
+		}
+		std::vector<uint32_t> stop_bus_offsets;
+		std::vector<BusIdx> stop_buses;
+		stop_bus_offsets.reserve(stop_count + 1);
+		stop_buses.reserve(l.stop_buses.size());
+		stop_bus_offsets.push_back(0);
+		for (StopIdx stop = 0; stop < stop_count; ++stop) {
+			if (touched[stop]) {
+				appendStopBuses(stop_buses, _route_stops[stop]);
 			}
-			if (_route_stops.count(stop_name_to)) {
-				return ComputeDistance(_route_stops.at(stop_name_from).location, _route_stops.at(stop_name_to).location);
+			else {
+				stop_buses.insert(stop_buses.end(), l.stop_buses.cbegin() + l.stop_bus_offsets[stop], l.stop_buses.cbegin() + l.stop_bus_offsets[stop + 1]);
 			}
+			stop_bus_offsets.push_back(static_cast<uint32_t>(stop_buses.size()));
 		}
+		l.stop_bus_offsets = std::move(stop_bus_offsets);
+		l.stop_buses = std::move(stop_buses);
 	}
-	return 0.0;
+
+	for (const auto& [from, to] : update.distances) {
+		refreshRoadDistance(from, to);
+	}
+
+	// The grid is recompiled by a counting sort, linear in the number of stops.
+	if (!update.moved_stops.empty() || stop_count != old_stop_count) {
+		compileStopGrid(l);
+	}
+
+	// Bit rows are as long as the bus count, so the transfer index is recompiled as a whole.
+	if (!update.buses.empty() || !update.served_stops.empty() || stop_count != old_stop_count) {
+		compileTransferIndex(l);
+	}
+
+	if (refit_bounds) {
+		l.stop_bounds = fitStopBounds(l);
+	}
+	else {
+		auto extend = [&](StopIdx stop) {
+			if (is_served(stop)) {
+				l.stop_bounds.extend({ l.stop_lat[stop], l.stop_lng[stop] });
+			}
+		};
+		std::for_each(update.served_stops.cbegin(), update.served_stops.cend(), extend);
+		std::for_each(update.moved_stops.cbegin(), update.moved_stops.cend(), extend);
+	}
+
+	l.route_stats.resize(_buses.size());
+	_view = _layout.view();
+
+	// Stats change with the route itself and with the coordinates or distances of its stops.
+	std::vector<BusIdx> stale_buses(update.buses);
+	auto add_serving = [&](StopIdx stop) {
+		Span<BusIdx> buses = _view.stopBuses(stop);
+		stale_buses.insert(stale_buses.end(), buses.cbegin(), buses.cend());
+	};
+	std::for_each(update.moved_stops.cbegin(), update.moved_stops.cend(), add_serving);
+	for (const auto& [from, to] : update.distances) {
+		add_serving(from);
+		add_serving(to);
+	}
+	std::sort(stale_buses.begin(), stale_buses.end());
+	stale_buses.erase(std::unique(stale_buses.begin(), stale_buses.end()), stale_buses.end());
+	for (BusIdx bus : stale_buses) {
+		l.route_stats[bus] = routeStats(bus);
+	}
+	if (recompile_routes) {
+		for (BusIdx bus = 0; bus < _buses.size(); ++bus) {
+			compileRouteSums(bus);
+		}
+	}
+	else {
+		std::for_each(stale_buses.cbegin(), stale_buses.cend(), [this](BusIdx bus) { compileRouteSums(bus); });
+	}
+	advanceGeneration();
 }
 
-std::vector<Trace> TransportCatalogue::findTracesByStopName(const std::string& name) const {
-	std::vector<Trace> result;
-	if (_route_stops.count(name)) {
-		std::for_each(
-			_route_stops.at(name).buses.cbegin(),
-			_route_stops.at(name).buses.cend(),
-			[&](BusID bid) {
-			Trace res;
-			res.bus_num = bid;
-			res.route = &_buses.at(bid);
-			result.push_back(std::move(res));
+bool TransportCatalogue::isFinalized() const {
+	return _finalized;
+}
+
+uint64_t TransportCatalogue::generation() const {
+	return _generation;
+}
+
+void TransportCatalogue::advanceGeneration() {
+	static std::atomic<uint64_t> next_generation{ 1u };
+	_generation = next_generation.fetch_add(1u);
+	_hierarchy = RoutingHierarchy();
+	_hierarchy_view = RoutingHierarchyView();
+}
+
+void TransportCatalogue::setRoutingHierarchy(RoutingHierarchy hierarchy) {
+	checkWritable();
+	if (!_finalized) {
+		throw std::logic_error("A routing hierarchy needs a finalized catalogue"s);
+	}
+	if (hierarchy.info.stop_count != _view.stopCount() || hierarchy.up_offsets.size() != hierarchy.info.stop_count + hierarchy.call_buses.size() + 1u) {
+		throw std::logic_error("The routing hierarchy was built for other data"s);
+	}
+	// Routers keyed on the generation pick the hierarchy up.
+	advanceGeneration();
+	_hierarchy = std::move(hierarchy);
+	_hierarchy_view = _hierarchy.view();
+}
+
+const RoutingHierarchyView& TransportCatalogue::routingHierarchy() const {
+	return _hierarchy_view;
+}
+
+void TransportCatalogue::SaveSnapshot(const std::string& path) const {
+	using snapshot::Section;
+	const CatalogueView& l = layout();
+	StringPoolRef stop_names = stopNames();
+	StringPoolRef bus_names = busNames();
+	std::vector<char> road_distance_values = snapshot::PackRoadDistances(l.road_distance_values);
+
+	snapshot::Writer writer;
+	writer.Add(Section::StopNameChars, stop_names.chars, stop_names.offsets[stop_names.count]);
+	writer.Add(Section::StopNameOffsets, Span<uint32_t>(stop_names.offsets, stop_names.count + 1));
+	writer.Add(Section::StopNameIndex, Span<uint32_t>(stop_names.slots, stop_names.capacity));
+	writer.Add(Section::BusNameChars, bus_names.chars, bus_names.offsets[bus_names.count]);
+	writer.Add(Section::BusNameOffsets, Span<uint32_t>(bus_names.offsets, bus_names.count + 1));
+	writer.Add(Section::BusNameIndex, Span<uint32_t>(bus_names.slots, bus_names.capacity));
+	writer.Add(Section::RouteOffsets, l.route_offsets);
+	writer.Add(Section::RouteStops, l.route_stops);
+	writer.Add(Section::RouteCircle, l.route_circle);
+	writer.Add(Section::StopBusOffsets, l.stop_bus_offsets);
+	writer.Add(Section::StopBuses, l.stop_buses);
+	writer.Add(Section::RoadDistanceKeys, l.road_distance_keys);
+	writer.Add(Section::RoadDistanceValues, road_distance_values.data(), road_distance_values.size());
+	writer.Add(Section::StopLat, l.stop_lat);
+	writer.Add(Section::StopLng, l.stop_lng);
+	writer.Add(Section::StopSinLat, l.stop_sin_lat);
+	writer.Add(Section::StopCosLat, l.stop_cos_lat);
+	writer.Add(Section::RouteStats, l.route_stats);
+	writer.Add(Section::StopBounds, &l.stop_bounds, sizeof(l.stop_bounds));
+	writer.Add(Section::GridCellOffsets, l.grid_cell_offsets);
+	writer.Add(Section::GridStops, l.grid_stops);
+	writer.Add(Section::StopGrid, &l.stop_grid, sizeof(l.stop_grid));
+	const RoutingHierarchyView& h = _hierarchy_view;
+	writer.Add(Section::RoutingInfo, &h.info, h.empty() ? 0u : sizeof(h.info));
+	writer.Add(Section::RoutingCallBuses, h.call_buses);
+	writer.Add(Section::RoutingUpOffsets, h.up_offsets);
+	writer.Add(Section::RoutingUpEdges, h.up_edges);
+	writer.Add(Section::RoutingDownOffsets, h.down_offsets);
+	writer.Add(Section::RoutingDownEdges, h.down_edges);
+	writer.Add(Section::RouteSumOffsets, l.route_sum_offsets);
+	writer.Add(Section::RouteDistanceSums, l.route_distance_sums);
+	writer.Add(Section::RouteLengthSums, l.route_length_sums);
+	writer.Add(Section::StopBusBits, l.stop_bus_bits);
+	writer.Add(Section::TransferKeys, l.transfer_keys);
+	writer.Add(Section::TransferValues, l.transfer_values);
+	writer.Add(Section::TransferStops, l.transfer_stops);
+	writer.Save(path);
+}
+
+void TransportCatalogue::LoadSnapshot(const std::string& path) {
+	std::vector<char> file = snapshot::ReadFile(path);
+	snapshot::Image image(file.data(), file.size(), snapshot::Verification::Full);
+	snapshot::CheckLayout(image, snapshot::Verification::Full);
+	_mapping.reset();
+
+	_stop_names.assign(snapshot::StopNames(image));
+	_bus_names.assign(snapshot::BusNames(image));
+
+	const CatalogueView view = snapshot::MakeView(image);
+	CatalogueLayout res;
+	auto assign = [](auto& dst, auto src) { dst.assign(src.begin(), src.end()); };
+	assign(res.route_offsets, view.route_offsets);
+	assign(res.route_stops, view.route_stops);
+	assign(res.route_circle, view.route_circle);
+	assign(res.stop_bus_offsets, view.stop_bus_offsets);
+	assign(res.stop_buses, view.stop_buses);
+	res.road_distances.assign(
+		{ view.road_distance_keys.begin(), view.road_distance_keys.end() },
+		{ view.road_distance_values.begin(), view.road_distance_values.end() }
+	);
+	assign(res.stop_lat, view.stop_lat);
+	assign(res.stop_lng, view.stop_lng);
+	assign(res.stop_sin_lat, view.stop_sin_lat);
+	assign(res.stop_cos_lat, view.stop_cos_lat);
+	assign(res.route_stats, view.route_stats);
+	assign(res.route_sum_offsets, view.route_sum_offsets);
+	assign(res.route_distance_sums, view.route_distance_sums);
+	assign(res.route_length_sums, view.route_length_sums);
+	assign(res.stop_bus_bits, view.stop_bus_bits);
+	res.transfers.assign(
+		{ view.transfer_keys.begin(), view.transfer_keys.end() },
+		{ view.transfer_values.begin(), view.transfer_values.end() }
+	);
+	assign(res.transfer_stops, view.transfer_stops);
+	res.stop_bounds = view.stop_bounds;
+	assign(res.grid_cell_offsets, view.grid_cell_offsets);
+	assign(res.grid_stops, view.grid_stops);
+	res.stop_grid = view.stop_grid;
+
+	// The ingestion-side state is rebuilt from the layout, so the catalogue can still be edited and
+	// finalized again after loading.
+	_route_stops.clear();
+	_route_stops.reserve(view.stopCount());
+	for (StopIdx stop = 0; stop < view.stopCount(); ++stop) {
+		Span<BusIdx> buses = view.stopBuses(stop);
+		_route_stops.push_back({
+			view.stopLocation(stop),
+			std::pmr::vector<BusIdx>(buses.begin(), buses.end(), _resource),
+			std::pmr::vector<StopDistance>(_resource)
+		});
+	}
+	for (size_t slot = 0; slot < view.road_distance_keys.size(); ++slot) {
+		const uint64_t key = view.road_distance_keys[slot];
+		if (key != RoadDistanceTable::EMPTY_KEY && !view.road_distance_values[slot].is_reverse) {
+			_route_stops[static_cast<StopIdx>(key >> 32)].distances.push_back({ static_cast<StopIdx>(key), view.road_distance_values[slot].distance });
 		}
-		);
 	}
+	_buses.clear();
+	_buses.reserve(view.busCount());
+	for (BusIdx bus = 0; bus < view.busCount(); ++bus) {
+		RouteRef route = view.route(bus);
+		_buses.push_back({ std::pmr::vector<StopIdx>(route.stops.begin(), route.stops.end(), _resource), route.isRouteCircle });
+	}
+
+	_layout = std::move(res);
+	_view = _layout.view();
+	_finalized = true;
+	advanceGeneration();
+
+	const RoutingHierarchyView hierarchy = snapshot::MakeRoutingHierarchy(image);
+	if (!hierarchy.empty()) {
+		_hierarchy.info = hierarchy.info;
+		assign(_hierarchy.call_buses, hierarchy.call_buses);
+		assign(_hierarchy.up_offsets, hierarchy.up_offsets);
+		assign(_hierarchy.up_edges, hierarchy.up_edges);
+		assign(_hierarchy.down_offsets, hierarchy.down_offsets);
+		assign(_hierarchy.down_edges, hierarchy.down_edges);
+		_hierarchy_view = _hierarchy.view();
+	}
+}
+
+void TransportCatalogue::MapSnapshot(const std::string& path, snapshot::Verification verification) {
+	auto mapping = std::make_unique<MappedFile>(path);
+	snapshot::Image image(mapping->data(), mapping->size(), verification);
+	snapshot::CheckLayout(image, verification);
+
+	_stop_names.clear();
+	_route_stops.clear();
+	_bus_names.clear();
+	_buses.clear();
+	_layout = CatalogueLayout();
+
+	_mapped_stop_names = snapshot::StopNames(image);
+	_mapped_bus_names = snapshot::BusNames(image);
+	_view = snapshot::MakeView(image);
+	_mapping = std::move(mapping);
+	_finalized = true;
+	advanceGeneration();
+	_hierarchy_view = snapshot::MakeRoutingHierarchy(image);
+}
+
+bool TransportCatalogue::isMapped() const {
+	return _mapping != nullptr;
+}
+
+void TransportCatalogue::checkWritable() const {
+	if (_mapping) {
+		throw std::logic_error("TransportCatalogue mapped from a snapshot is read-only"s);
+	}
+}
+
+void TransportCatalogue::invalidate() {
+	checkWritable();
+	_finalized = false;
+}
+
+StringPoolRef TransportCatalogue::stopNames() const {
+	return _mapping ? _mapped_stop_names : _stop_names.ref();
+}
+
+StringPoolRef TransportCatalogue::busNames() const {
+	return _mapping ? _mapped_bus_names : _bus_names.ref();
+}
+
+GeoPointsRef TransportCatalogue::geoPoints() const {
+	const CatalogueView& l = layout();
+	return { l.stop_lng.data(), l.stop_sin_lat.data(), l.stop_cos_lat.data() };
+}
+
+const CatalogueView& TransportCatalogue::layout() const {
+	if (!_finalized) {
+		throw std::logic_error("TransportCatalogue is queried before Finalize()"s);
+	}
+	return _view;
+}
+
+std::vector<Trace> TransportCatalogue::findTracesByStopName(std::string_view name) const {
+	std::optional<StopIdx> stop = findStopIdx(name);
+	if (stop) {
+		return findTraces(*stop);
+	}
+	return {};
+}
+
+std::vector<Trace> TransportCatalogue::findTraces(StopIdx stop) const {
+	std::vector<Trace> result;
+	const CatalogueView& l = layout();
+	Span<BusIdx> buses = l.stopBuses(stop);
+	result.reserve(buses.size());
+	std::for_each(
+		buses.cbegin(),
+		buses.cend(),
+		[&](BusIdx bus) {
+		Trace res;
+		res.bus_num = BusID(busNames()[bus]);
+		res.route = l.route(bus);
+		result.push_back(std::move(res));
+	}
+	);
 
 	return result;
 }
 
 std::vector<BusID> TransportCatalogue::getAllBusesIds() const {
+	StringPoolRef bus_names = busNames();
 	std::vector<BusID> res;
-	res.reserve(_buses.size());
-	for (auto const& [key, _] : _buses) { res.push_back(key); }
+	res.reserve(bus_names.size());
+	for (BusIdx bus = 0; bus < bus_names.size(); ++bus) {
+		if (bus_names.contains(bus)) {
+			res.emplace_back(bus_names[bus]);
+		}
+	}
 	return res;
 }
 
 RoutesInfo TransportCatalogue::getAllRoutesInfo() const {
+	const CatalogueView& l = layout();
+	StringPoolRef stop_names = stopNames();
+	StringPoolRef bus_names = busNames();
 	RoutesInfo res;
-	res.reserve(_buses.size());
-	for (auto const& [bid, route] : _buses) {
+	res.reserve(l.busCount());
+	for (BusIdx bus = 0; bus < l.busCount(); ++bus) {
+		RouteRef route = l.route(bus);
 		std::vector<LocalBusFull> all_lbf;
-		for (auto const& sn : route.stops) {
-			const LocalBuses& lb = _route_stops.at(sn);
-			all_lbf.push_back({ lb.location, sn, lb.buses });
+		for (StopIdx stop : route.stops) {
+			std::set<BusID> buses;
+			for (BusIdx stop_bus : l.stopBuses(stop)) {
+				buses.emplace(bus_names[stop_bus]);
+			}
+			all_lbf.push_back({ l.stopLocation(stop), RouteStopName(stop_names[stop]), std::move(buses) });
 		}
-		res.insert({ bid, { all_lbf, route.isRouteCircle } });
+		res.insert({ BusID(bus_names[bus]), { all_lbf, route.isRouteCircle } });
 	}
 
 	return RoutesInfo();
 }
 
 LocalBusFullRef TransportCatalogue::getAllRoutesInfoRef() const {
-	return {&_buses, &_route_stops};
+	return { &layout(), busNames(), stopNames() };
+}
+
+Span<BusIdx> TransportCatalogue::findStopBuses(StopIdx stop) const {
+	return layout().stopBuses(stop);
+}
+
+std::vector<BusIdx> TransportCatalogue::findSharedBuses(StopIdx first, StopIdx second) const {
+	const CatalogueView& l = layout();
+	std::vector<BusIdx> res;
+	IntersectBitSets(l.stopBusBits(first), l.stopBusBits(second), BitSetWords(l.busCount()), res);
+	return res;
+}
+
+Span<StopIdx> TransportCatalogue::findTransferStops(BusIdx first, BusIdx second) const {
+	return layout().transferStops(first, second);
+}
+
+bool TransportCatalogue::isStopNameExists(std::string_view name) const {
+	return stopNames().find(name) != StringPool::NPOS;
 }
 
-bool TransportCatalogue::isStopNameExists(const std::string& name) const {
-	if (_route_stops.count(name)) {
-		return true;
+const LocalBuses& TransportCatalogue::findLocalBusesByStopName(std::string_view name) const {
+	if (_mapping) {
+		throw std::logic_error("Ingestion data is not available on a mapped snapshot"s);
 	}
-	else {
-		return false;
+	return _route_stops[stopIdx(name)];
+}
+
+
+bool TransportCatalogue::isBusIDExists(std::string_view bid) const {
+	return busNames().find(bid) != StringPool::NPOS;
+}
+
+RouteRef TransportCatalogue::findRouteByBusID(std::string_view bid) const {
+	return layout().route(busIdx(bid));
+}
+
+RouteRef TransportCatalogue::findRoute(BusIdx bus) const {
+	return layout().route(bus);
+}
+
+const RouteStats& TransportCatalogue::findRouteStatsByBusID(std::string_view bid) const {
+	return layout().route_stats[busIdx(bid)];
+}
+
+const RouteStats& TransportCatalogue::findRouteStats(BusIdx bus) const {
+	return layout().route_stats[bus];
+}
+
+std::optional<StopIdx> TransportCatalogue::findStopIdx(std::string_view name) const {
+	uint32_t stop = stopNames().find(name);
+	if (stop != StringPool::NPOS) {
+		return stop;
 	}
+	return std::nullopt;
+}
+
+std::optional<BusIdx> TransportCatalogue::findBusIdx(std::string_view bid) const {
+	uint32_t bus = busNames().find(bid);
+	if (bus != StringPool::NPOS) {
+		return bus;
+	}
+	return std::nullopt;
+}
+
+std::string_view TransportCatalogue::getStopName(StopIdx idx) const {
+	return stopNames()[idx];
 }
 
-const LocalBuses& TransportCatalogue::findLocalBusesByStopName(const std::string& name) const {
-	return _route_stops.at(name);
+std::string_view TransportCatalogue::getBusName(BusIdx idx) const {
+	return busNames()[idx];
 }
 
+RouteStats TransportCatalogue::routeStats(std::string_view bid) const {
+	return routeStats(busIdx(bid));
+}
 
-bool TransportCatalogue::isBusIDExists(const BusID& bid) const {
-	if (_buses.count(bid)) {
-		return true;
+RouteStats TransportCatalogue::routeStats(BusIdx bus) const {
+	const CatalogueView& l = layout();
+	RouteRef rt = findRoute(bus);
+	RouteStats res{ 0.0, 0.0, 0.0, 0u, 0u };
+	if (rt.stops.empty()) {
+		return res;
 	}
-	else {
-		return false;
+
+	thread_local std::vector<double> segment_lengths;
+	segment_lengths.resize(rt.stops.size());
+	GeoPointsRef points = geoPoints();
+	ComputeSegmentDistances(points, rt.stops.data(), rt.stops.size(), segment_lengths.data());
+	if (rt.isRouteCircle) {
+		segment_lengths.back() = ComputeDistance(points, rt.stops.back(), rt.stops.front());
+	}
+
+	size_t segment = 0;
+	forEachRouteSegment(
+		rt,
+		[&](StopIdx from, StopIdx to) {
+		double length = segment_lengths[segment++];
+		const RoadDistance* forward = l.roadDistance(from, to);
+		res.length += length;
+		res.distance += forward ? forward->distance : length;
+		if (!rt.isRouteCircle) {
+			const RoadDistance* backward = l.roadDistance(to, from);
+			res.distance += backward ? backward->distance : length;
+		}
+	}
+	);
+	if (!rt.isRouteCircle) {
+		res.length *= 2;
+	}
+	res.curvature = res.distance / res.length;
+	res.stop_count = static_cast<uint32_t>(rt.isRouteCircle ? rt.stops.size() + 1 : rt.stops.size() + rt.stops.size() - 1);
+
+	std::vector<StopIdx> unique_stops(rt.stops.cbegin(), rt.stops.cend());
+	std::sort(unique_stops.begin(), unique_stops.end());
+	res.unique_stop_count = static_cast<uint32_t>(std::unique(unique_stops.begin(), unique_stops.end()) - unique_stops.begin());
+	return res;
+}
+
+std::optional<RouteSection> TransportCatalogue::findRouteSection(BusIdx bus, StopIdx from, StopIdx to) const {
+	const CatalogueView& l = layout();
+	RouteRef rt = l.route(bus);
+	Span<double> distance_sums = l.routeDistanceSums(bus);
+	Span<double> length_sums = l.routeLengthSums(bus);
+	if (rt.stops.empty()) {
+		return std::nullopt;
+	}
+	// Positions of a ride, the last one left out as it is the first again.
+	const size_t n = rt.stops.size();
+	const size_t segment_count = distance_sums.size() - 1;
+	const size_t position_count = std::max<size_t>(segment_count, 1u);
+	thread_local std::vector<size_t> from_positions;
+	thread_local std::vector<size_t> to_positions;
+	from_positions.clear();
+	to_positions.clear();
+	for (size_t position = 0; position < position_count; ++position) {
+		const StopIdx stop = rt.stops[position < n ? position : 2 * n - 2 - position];
+		if (stop == from) {
+			from_positions.push_back(position);
+		}
+		if (stop == to) {
+			to_positions.push_back(position);
+		}
+	}
+
+	std::optional<RouteSection> res;
+	for (size_t i : from_positions) {
+		for (size_t j : to_positions) {
+			RouteSection section;
+			if (i <= j) {
+				section = { length_sums[j] - length_sums[i], distance_sums[j] - distance_sums[i], static_cast<uint32_t>(j - i + 1) };
+			}
+			else {
+				section = {
+					length_sums[segment_count] - length_sums[i] + length_sums[j],
+					distance_sums[segment_count] - distance_sums[i] + distance_sums[j],
+					static_cast<uint32_t>(segment_count - i + j + 1)
+				};
+			}
+			if (!res || section.distance < res->distance || (section.distance == res->distance && section.stop_count < res->stop_count)) {
+				res = section;
+			}
+		}
+	}
+	return res;
+}
+
+std::vector<std::pair<StopIdx, double>> TransportCatalogue::findNearestStops(Coordinates point, size_t count) const {
+	const CatalogueView& l = layout();
+	const StopGrid& grid = l.stop_grid;
+	// Max-heap of the best candidates so far, ties broken by id so that the answer is deterministic.
+	std::vector<std::pair<StopIdx, double>> res;
+	auto closer = [](const std::pair<StopIdx, double>& lhs, const std::pair<StopIdx, double>& rhs) {
+		return lhs.second < rhs.second || (lhs.second == rhs.second && lhs.first < rhs.first);
+	};
+	if (count == 0 || l.grid_stops.empty()) {
+		return res;
+	}
+	res.reserve(std::min(count, l.grid_stops.size()));
+
+	GeoPointsRef points = geoPoints();
+	auto visit = [&](int64_t row, int64_t col) {
+		if (row < 0 || col < 0 || row >= grid.rows || col >= grid.cols) {
+			return;
+		}
+		const uint32_t cell = grid.cell(static_cast<uint32_t>(row), static_cast<uint32_t>(col));
+		for (uint32_t i = l.grid_cell_offsets[cell]; i < l.grid_cell_offsets[cell + 1]; ++i) {
+			std::pair<StopIdx, double> candidate{ l.grid_stops[i], ComputeDistance(point, points, l.grid_stops[i]) };
+			if (res.size() < count) {
+				res.push_back(candidate);
+				std::push_heap(res.begin(), res.end(), closer);
+			}
+			else if (closer(candidate, res.front())) {
+				std::pop_heap(res.begin(), res.end(), closer);
+				res.back() = candidate;
+				std::push_heap(res.begin(), res.end(), closer);
+			}
+		}
+	};
+
+	// Rings of cells around the cell of point, until nothing outside the rings searched so far can
+	// beat the farthest candidate.
+	const int64_t row = grid.row(point.lat);
+	const int64_t col = grid.col(point.lng);
+	const double max_lat = grid.min_lat + grid.rows * grid.cell_lat;
+	const double max_abs_lat = std::max({ std::abs(point.lat), std::abs(grid.min_lat), std::abs(max_lat) });
+	constexpr double unbounded = std::numeric_limits<double>::infinity();
+	const int64_t max_ring = std::max(grid.rows, grid.cols);
+	for (int64_t ring = 0; ring <= max_ring; ++ring) {
+		for (int64_t c = col - ring; c <= col + ring; ++c) {
+			visit(row - ring, c);
+			if (ring != 0) {
+				visit(row + ring, c);
+			}
+		}
+		for (int64_t r = row - ring + 1; r <= row + ring - 1; ++r) {
+			visit(r, col - ring);
+			visit(r, col + ring);
+		}
+		if (res.size() < count) {
+			continue;
+		}
+		auto gap = [](int64_t first, int64_t last, int64_t cells, double origin, double cell, double x) {
+			const double below = first <= 0 ? unbounded : x - (origin + first * cell);
+			const double above = last >= cells - 1 ? unbounded : origin + (last + 1) * cell - x;
+			return std::max(0.0, std::min(below, above));
+		};
+		const double lat_gap = gap(row - ring, row + ring, grid.rows, grid.min_lat, grid.cell_lat, point.lat);
+		const double lng_gap = gap(col - ring, col + ring, grid.cols, grid.min_lng, grid.cell_lng, point.lng);
+		if (ComputeDistanceLowerBound(lat_gap, lng_gap, max_abs_lat) > res.front().second) {
+			break;
+		}
 	}
+	std::sort_heap(res.begin(), res.end(), closer);
+	return res;
 }
 
-const Route& TransportCatalogue::findRouteByBusID(const BusID& bid) const {
-	return _buses.at(bid);
+std::vector<StopIdx> TransportCatalogue::findStopsInArea(const GeoBounds& area) const {
+	const CatalogueView& l = layout();
+	const StopGrid& grid = l.stop_grid;
+	std::vector<StopIdx> res;
+	if (area.min_lat > area.max_lat || area.min_lng > area.max_lng) {
+		return res;
+	}
+	for (uint32_t row = grid.row(area.min_lat); row <= grid.row(area.max_lat); ++row) {
+		const uint32_t first = grid.cell(row, grid.col(area.min_lng));
+		const uint32_t last = grid.cell(row, grid.col(area.max_lng));
+		for (uint32_t i = l.grid_cell_offsets[first]; i < l.grid_cell_offsets[last + 1]; ++i) {
+			const StopIdx stop = l.grid_stops[i];
+			const double lat = l.stop_lat[stop];
+			const double lng = l.stop_lng[stop];
+			if (lat >= area.min_lat && lat <= area.max_lat && lng >= area.min_lng && lng <= area.max_lng) {
+				res.push_back(stop);
+			}
+		}
+	}
+	return res;
 }
 
-double TransportCatalogue::routeLength(const BusID& bid) const {
-	return routeMeasure<double>(
-		bid,
-		[=](const std::string& stop_name_from, const std::string& stop_name_to) {
-		return this->getLength(stop_name_from, stop_name_to);
-	},
-		false
-		);
+double TransportCatalogue::routeLength(std::string_view bid) const {
+	return findRouteStatsByBusID(bid).length;
 }
 
-double TransportCatalogue::routeDistance(const BusID& bid) const {
-	return routeMeasure<double>(
-		bid,
-		[=](const std::string& stop_name_from, const std::string& stop_name_to) {
-		return this->getFromDistanceOrLength(stop_name_from, stop_name_to);
-	},
-		true
-		);
-}
\ No newline at end of file
+double TransportCatalogue::routeDistance(std::string_view bid) const {
+	return findRouteStatsByBusID(bid).distance;
+}
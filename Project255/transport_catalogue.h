@@ -1,7 +1,10 @@
 #pragma once
 
 #include <list>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <memory_resource>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -9,96 +12,272 @@
 #include <vector>
 #include <set>
 #include <functional>
+#include <optional>
+#include <execution>
+#include <algorithm>
 
 #include "geo.h"
 #include "domain.h"
+#include "string_pool.h"
+#include "catalogue_snapshot.h"
+#include "mapped_file.h"
+
+// How Finalize() numbers stops. Insertion keeps the order in which stops were first named. Hilbert
+// sorts them along a Hilbert curve over their coordinates, so that stops close on the ground get
+// close ids and their rows of the layout share cache lines.
+enum class StopOrder {
+	Insertion,
+	Hilbert
+};
 
 class TransportCatalogue {
-	Buses _buses;
+	// Default resource for catalogues built without a caller-supplied one; it has to be declared
+	// before every container allocating from it.
+	std::pmr::unsynchronized_pool_resource _pool;
+	std::pmr::memory_resource* _resource;
+
+	StringPool _stop_names;
 	RouteStops _route_stops;
 
+	StringPool _bus_names;
+	Buses _buses;
+
+	CatalogueLayout _layout;
+	// Points into _layout, or into _mapping for a catalogue mapped from a snapshot.
+	CatalogueView _view;
+	std::unique_ptr<MappedFile> _mapping;
+	StringPoolRef _mapped_stop_names{};
+	StringPoolRef _mapped_bus_names{};
+	bool _finalized = false;
+	uint64_t _generation = 0;
+	StopOrder _stop_order = StopOrder::Insertion;
+	// Points into _hierarchy, or into _mapping.
+	RoutingHierarchy _hierarchy;
+	RoutingHierarchyView _hierarchy_view;
+
 public:
+	TransportCatalogue();
+	// The stop and bus name pools, the bus and distance lists of every stop and the stop lists of
+	// every route allocate from resource, which must outlive the catalogue and is not used from
+	// several threads at once. The compiled layout and routing hierarchy stay on the global
+	// allocator. Without a resource the catalogue owns an unsynchronized pool: bulk loads pay a
+	// little bookkeeping per block instead of bumping a pointer, but blocks freed by edits,
+	// renumbering and snapshot loads are reused by later ones, so the pooled part of an edited
+	// catalogue stays within its peak size instead of growing with every change. A caller-supplied
+	// resource keeps its own semantics, e.g. a monotonic buffer suits a catalogue never edited.
+	explicit TransportCatalogue(std::pmr::memory_resource* resource);
+	TransportCatalogue(const TransportCatalogue&) = delete;
+	TransportCatalogue& operator=(const TransportCatalogue&) = delete;
+
+	std::pmr::memory_resource* resource() const;
+
 	void addRoute(BusID bus_num, Route route);
 	void addRoute(BusID bus_num, std::vector<RouteStopName> stops);
 	void addRoute(BusID bus_num, std::vector<RouteStopName> stops, bool isCircle);
 
-	void addRouteStop(const std::string& stop_name, Coordinates coords, Distances distances);
+	void addRouteStop(std::string_view stop_name, Coordinates coords, Distances distances);
+
+	void Load(const std::vector<StopLoadData>& stops, const std::vector<BusLoadData>& buses);
+	template<typename ExecutionPolicy>
+	void Load(ExecutionPolicy&& policy, const std::vector<StopLoadData>& stops, const std::vector<BusLoadData>& buses);
+
+	void setDistances(std::string_view stop_name, Distances distances);
+	void setDistance(std::string_view stop_name_from, std::string_view stop_name_to, dist distance);
+	dist getFromDistance(std::string_view stop_name_from, std::string_view stop_name_to) const;
+	double getLength(std::string_view stop_name_from, std::string_view stop_name_to) const;
+	double getFromDistanceOrLength(std::string_view stop_name_from, std::string_view stop_name_to) const;
+
+	dist getFromDistance(StopIdx from, StopIdx to) const;
+	double getLength(StopIdx from, StopIdx to) const;
+	double getFromDistanceOrLength(StopIdx from, StopIdx to) const;
+
+	// Edits of a built catalogue. On a finalized catalogue each edit re-derives only what depends on
+	// it (route stats, per-stop bus lists, stop bounds) and the catalogue stays finalized; otherwise
+	// the edit is picked up by the next Finalize().
+	void updateRoute(std::string_view bid, const std::vector<RouteStopName>& stops, bool isCircle);
+	void removeRoute(std::string_view bid);
+	void updateRouteStop(std::string_view stop_name, Coordinates coords, const Distances& distances);
+	// Throws std::logic_error while the stop is still served by a bus.
+	void removeRouteStop(std::string_view stop_name);
+	void updateDistance(std::string_view stop_name_from, std::string_view stop_name_to, dist distance);
+
+	void Finalize();
+	template<typename ExecutionPolicy>
+	void Finalize(ExecutionPolicy&& policy);
+	bool isFinalized() const;
+	// Identifies the data behind the queries: a new value, never reused within the process, after every
+	// Finalize(), edit of a finalized catalogue and snapshot load. Indexes derived from a catalogue
+	// can be keyed on it.
+	uint64_t generation() const;
+
+	// With StopOrder::Hilbert every StopIdx may change on the next Finalize(); stops added by later
+	// edits of the finalized catalogue get fresh ids at the end until the Finalize() after that.
+	void setStopOrder(StopOrder order);
+	StopOrder stopOrder() const;
+
+	// Contraction hierarchy picked up by TransportRouter for the same routing settings and saved with
+	// the snapshot. It describes the current data only: the next Finalize() or edit drops it.
+	void setRoutingHierarchy(RoutingHierarchy hierarchy);
+	const RoutingHierarchyView& routingHierarchy() const;
 
-	void setDistances(const std::string& stop_name, Distances distances);
-	void setDistance(const std::string& stop_name_from, const std::string& stop_name_to, dist distance);
-	dist getFromDistance(const std::string& stop_name_from, const std::string& stop_name_to) const;
-	double getLength(const std::string& stop_name_from, const std::string& stop_name_to) const;
-	double getFromDistanceOrLength(const std::string& stop_name_from, const std::string& stop_name_to) const;
+	void SaveSnapshot(const std::string& path) const;
+	void LoadSnapshot(const std::string& path);
+	// Serves every const query straight from the mapped file; the catalogue becomes read-only until
+	// the next LoadSnapshot()/MapSnapshot().
+	void MapSnapshot(const std::string& path, snapshot::Verification verification = snapshot::Verification::Structure);
+	bool isMapped() const;
 
-	std::vector<Trace> findTracesByStopName(const std::string& name) const;
+	std::vector<Trace> findTracesByStopName(std::string_view name) const;
+	std::vector<Trace> findTraces(StopIdx stop) const;
+	Span<BusIdx> findStopBuses(StopIdx stop) const;
+	// Buses calling at both stops, by id, found by intersecting the bus bit sets of the stops.
+	std::vector<BusIdx> findSharedBuses(StopIdx first, StopIdx second) const;
+	// Stops where both buses call, by id, from the transfer index compiled by Finalize(); every stop
+	// of the bus when first == second.
+	Span<StopIdx> findTransferStops(BusIdx first, BusIdx second) const;
 	std::vector<BusID> getAllBusesIds() const;
 	RoutesInfo getAllRoutesInfo() const;
 	LocalBusFullRef getAllRoutesInfoRef() const;
 
-	bool isStopNameExists(const std::string& name) const;
-	const LocalBuses& findLocalBusesByStopName(const std::string& name) const;
+	bool isStopNameExists(std::string_view name) const;
+	const LocalBuses& findLocalBusesByStopName(std::string_view name) const;
 
-	bool isBusIDExists(const BusID& bid) const;
-	const Route& findRouteByBusID(const BusID& bid) const;
+	bool isBusIDExists(std::string_view bid) const;
+	RouteRef findRouteByBusID(std::string_view bid) const;
+	RouteRef findRoute(BusIdx bus) const;
+	const RouteStats& findRouteStatsByBusID(std::string_view bid) const;
+	const RouteStats& findRouteStats(BusIdx bus) const;
 
-	double routeLength(const BusID& bid) const;
-	double routeDistance(const BusID& bid) const;
+	std::optional<StopIdx> findStopIdx(std::string_view name) const;
+	std::optional<BusIdx> findBusIdx(std::string_view bid) const;
+	std::string_view getStopName(StopIdx idx) const;
+	std::string_view getBusName(BusIdx idx) const;
+
+	RouteStats routeStats(std::string_view bid) const;
+	RouteStats routeStats(BusIdx bus) const;
+	// Shortest ride on bus from stop from to stop to, by road distance and then by stops, read off the
+	// sums compiled by Finalize(). The ride may go on past the end of the route into the next round.
+	// Empty when the bus does not call at both stops.
+	std::optional<RouteSection> findRouteSection(BusIdx bus, StopIdx from, StopIdx to) const;
+
+	// Up to count live stops closest to point, with their distances in meters, nearest first.
+	std::vector<std::pair<StopIdx, double>> findNearestStops(Coordinates point, size_t count) const;
+	// Live stops inside area, borders included, in no particular order.
+	std::vector<StopIdx> findStopsInArea(const GeoBounds& area) const;
+
+	double routeLength(std::string_view bid) const;
+	double routeDistance(std::string_view bid) const;
 
 private:
-	template<typename D>
-	double routeMeasure(const BusID& bid, std::function<D(const std::string& stop_name_from, const std::string& stop_name_to)> dist_from_fn, bool full_measure) const;
+	// Scratch state of a bulk Load(). Items (stops followed by buses) are cut into a fixed number of
+	// contiguous chunks, and per-chunk results are merged in chunk order, so the catalogue built does
+	// not depend on the execution policy or the number of threads.
+	struct LoadBatch {
+		const std::vector<StopLoadData>* stops;
+		const std::vector<BusLoadData>* buses;
+		std::vector<size_t> chunk_offsets;
+		std::vector<size_t> name_hashes;
+		std::vector<StopIdx> stop_ids;
+		std::vector<BusIdx> bus_ids;
+		std::vector<std::vector<std::string_view>> missing_stops;
+		std::vector<size_t> distance_offsets;
+		std::vector<StopDistance> distances;
+		std::vector<size_t> route_offsets;
+		std::vector<size_t> route_sizes;
+		std::vector<StopIdx> route_stops;
+	};
+
+	static constexpr size_t LOAD_CHUNK_COUNT = 256u;
+	static constexpr size_t GRID_STOPS_PER_CELL = 2u;
+
+	// What an edit of a finalized catalogue touched; see updateLayout().
+	struct LayoutUpdate {
+		std::vector<BusIdx> buses;                          // route added, replaced or removed
+		std::vector<StopIdx> served_stops;                  // gained or lost a bus
+		std::vector<StopIdx> moved_stops;                   // coordinates changed
+		std::vector<std::pair<StopIdx, StopIdx>> distances; // declared distance from -> to changed
+	};
+
+	StopIdx internStop(std::string_view name);
+	StopIdx internStop(std::string_view name, size_t hash);
+	BusIdx internBus(std::string_view bid);
+	BusIdx internBus(std::string_view bid, size_t hash);
+	StopIdx stopIdx(std::string_view name) const;
+	BusIdx busIdx(std::string_view bid) const;
+	std::pmr::vector<StopDistance> internDistances(const Distances& distances);
+	Route internRoute(const std::vector<RouteStopName>& stops, bool isCircle);
+	const CatalogueView& layout() const;
+	void checkWritable() const;
+	void invalidate();
+	void advanceGeneration();
+	StringPoolRef stopNames() const;
+	StringPoolRef busNames() const;
+	GeoPointsRef geoPoints() const;
+	void renumberStops();
+	void compileLayout();
+	void compileRoutes(CatalogueLayout& res) const;
+	void compileRouteSums(BusIdx bus);
+	void appendStopBuses(std::vector<BusIdx>& stop_buses, const LocalBuses& lb) const;
+	GeoBounds fitStopBounds(const CatalogueLayout& res) const;
+	void compileStopGrid(CatalogueLayout& res) const;
+	void compileTransferIndex(CatalogueLayout& res) const;
+
+	void detachRoute(BusIdx bus, LayoutUpdate& update);
+	void setStopDistances(StopIdx stop, std::pmr::vector<StopDistance> distances, LayoutUpdate& update);
+	void refreshRoadDistance(StopIdx from, StopIdx to);
+	void updateLayout(const LayoutUpdate& update);
+
+	template<typename SegmentFn>
+	void forEachRouteSegment(RouteRef rt, SegmentFn&& segment_fn) const;
+
+	LoadBatch prepareLoad(const std::vector<StopLoadData>& stops, const std::vector<BusLoadData>& buses);
+	void hashLoadChunk(LoadBatch& batch, size_t chunk) const;
+	void declareLoad(LoadBatch& batch);
+	void scanLoadChunk(LoadBatch& batch, size_t chunk) const;
+	void internMissingStops(LoadBatch& batch);
+	void resolveLoadChunk(LoadBatch& batch, size_t chunk) const;
+	void commitLoad(LoadBatch& batch);
 };
 
-template<typename D>
-inline double TransportCatalogue::routeMeasure(const BusID& bid, std::function<D(const std::string& stop_name_from, const std::string& stop_name_to)> dist_from_fn, bool full_measure) const {
-	const Route& rt = this->findRouteByBusID(bid);
+template<typename ExecutionPolicy>
+inline void TransportCatalogue::Load(ExecutionPolicy&& policy, const std::vector<StopLoadData>& stops, const std::vector<BusLoadData>& buses) {
+	LoadBatch batch = prepareLoad(stops, buses);
+	std::vector<size_t> chunks(batch.chunk_offsets.size() - 1);
+	std::iota(chunks.begin(), chunks.end(), size_t{ 0 });
+
+	std::for_each(policy, chunks.cbegin(), chunks.cend(), [&](size_t chunk) { hashLoadChunk(batch, chunk); });
+	declareLoad(batch);
+	std::for_each(policy, chunks.cbegin(), chunks.cend(), [&](size_t chunk) { scanLoadChunk(batch, chunk); });
+	internMissingStops(batch);
+	std::for_each(policy, chunks.cbegin(), chunks.cend(), [&](size_t chunk) { resolveLoadChunk(batch, chunk); });
+	commitLoad(batch);
+}
+
+template<typename ExecutionPolicy>
+inline void TransportCatalogue::Finalize(ExecutionPolicy&& policy) {
+	compileLayout();
+	std::vector<BusIdx> buses(_view.busCount());
+	std::iota(buses.begin(), buses.end(), BusIdx{ 0 });
+	std::transform(
+		policy,
+		buses.cbegin(),
+		buses.cend(),
+		_layout.route_stats.begin(),
+		[this](BusIdx bus) { return routeStats(bus); }
+	);
+	std::for_each(policy, buses.cbegin(), buses.cend(), [this](BusIdx bus) { compileRouteSums(bus); });
+}
+
+template<typename SegmentFn>
+inline void TransportCatalogue::forEachRouteSegment(RouteRef rt, SegmentFn&& segment_fn) const {
 	if (rt.stops.size() == 0) {
-		return 0.0;
+		return;
 	}
-	D res = 0.0;
-	const std::string& start = rt.stops[0];
-	std::string temp = start;
-	if (rt.isRouteCircle) {
-		std::for_each(
-			rt.stops.cbegin() + 1,
-			rt.stops.cend(),
-			[&](const std::string& stopName) {
-			res += dist_from_fn(temp, stopName);
-			temp = stopName;
-		}
-		);
-		return res + dist_from_fn(temp, start);
+	const StopIdx* prev = rt.stops.begin();
+	for (const StopIdx* it = prev + 1; it != rt.stops.end(); prev = it++) {
+		segment_fn(*prev, *it);
 	}
-	else {
-		if (full_measure) {
-			std::for_each(
-				rt.stops.cbegin() + 1,
-				rt.stops.cend(),
-				[&](const std::string& stopName) {
-				res += dist_from_fn(temp, stopName);
-				temp = stopName;
-			}
-			);
-			std::for_each(
-				rt.stops.crbegin() + 1,
-				rt.stops.crend(),
-				[&](const std::string& stopName) {
-				res += dist_from_fn(temp, stopName);
-				temp = stopName;
-			}
-			);
-		}
-		else {
-			std::for_each(
-				rt.stops.cbegin() + 1,
-				rt.stops.cend(),
-				[&](const std::string& stopName) {
-				res += dist_from_fn(temp, stopName);
-				temp = stopName;
-			}
-			);
-			res *= 2;
-		}
-		return res;
+	if (rt.isRouteCircle) {
+		segment_fn(rt.stops.back(), rt.stops.front());
 	}
 }
@@ -0,0 +1,619 @@
+#include "transport_router.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+	constexpr uint32_t NO_VERTEX = HierarchyEdge::NO_VERTEX;
+	constexpr double UNREACHED = std::numeric_limits<double>::infinity();
+
+	// Search scratch reused by every search of a thread: a vertex whose stamp differs from the current
+	// one has not been reached yet, so nothing is cleared between searches.
+	struct SearchState {
+		std::vector<double> time;
+		std::vector<uint32_t> parent;
+		std::vector<uint32_t> parent_edge;
+		std::vector<uint32_t> stamp;
+		std::vector<std::pair<double, uint32_t>> heap;
+		uint32_t current = 0;
+
+		void reset(size_t vertex_count) {
+			if (stamp.size() < vertex_count) {
+				time.resize(vertex_count);
+				parent.resize(vertex_count);
+				parent_edge.resize(vertex_count);
+				stamp.resize(vertex_count, 0u);
+			}
+			if (++current == 0u) {
+				std::fill(stamp.begin(), stamp.end(), 0u);
+				current = 1u;
+			}
+			heap.clear();
+		}
+
+		bool reached(uint32_t vertex) const {
+			return stamp[vertex] == current;
+		}
+
+		double timeOf(uint32_t vertex) const {
+			return reached(vertex) ? time[vertex] : UNREACHED;
+		}
+
+		// Labels vertex and queues it unless it is already reached no later.
+		void reach(uint32_t vertex, double t, uint32_t from, uint32_t edge) {
+			if (reached(vertex) && time[vertex] <= t) {
+				return;
+			}
+			stamp[vertex] = current;
+			time[vertex] = t;
+			parent[vertex] = from;
+			parent_edge[vertex] = edge;
+			heap.push_back({ t, vertex });
+			std::push_heap(heap.begin(), heap.end(), std::greater<std::pair<double, uint32_t>>());
+		}
+
+		double nextTime() const {
+			return heap.empty() ? UNREACHED : heap.front().first;
+		}
+
+		// Next vertex to settle; false once the queue is exhausted. Outdated entries are skipped.
+		bool settle(double& t, uint32_t& vertex) {
+			while (!heap.empty()) {
+				std::pop_heap(heap.begin(), heap.end(), std::greater<std::pair<double, uint32_t>>());
+				std::tie(t, vertex) = heap.back();
+				heap.pop_back();
+				if (t <= time[vertex]) {
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+
+	SearchState& GraphState() {
+		thread_local SearchState state;
+		return state;
+	}
+
+	// Settles everything source reaches over one direction of a hierarchy, calling settle(vertex, time)
+	// in order of time.
+	template<typename SettleFn>
+	void SearchUpward(SearchState& state, size_t vertex_count, uint32_t source, Span<uint32_t> offsets, Span<HierarchyEdge> edges, SettleFn&& settle) {
+		state.reset(vertex_count);
+		state.reach(source, 0.0, source, NO_VERTEX);
+		double time;
+		uint32_t vertex;
+		while (state.settle(time, vertex)) {
+			settle(vertex, time);
+			for (uint32_t e = offsets[vertex]; e < offsets[vertex + 1u]; ++e) {
+				state.reach(edges[e].to, time + edges[e].weight, vertex, e);
+			}
+		}
+	}
+}
+
+// Contracts the graph of a router vertex by vertex, keeping a mutable adjacency of the vertices not
+// contracted yet. Incoming arcs name their source in to.
+class TransportRouter::Contractor {
+public:
+	explicit Contractor(const TransportRouter& router) : _router(router) {
+		const size_t vertex_count = router._edge_offsets.size() - 1u;
+		_out.resize(vertex_count);
+		_in.resize(vertex_count);
+		_contracted_neighbours.assign(vertex_count, 0u);
+		_levels.assign(vertex_count, 0u);
+		for (uint32_t from = 0; from < vertex_count; ++from) {
+			for (uint32_t e = router._edge_offsets[from]; e < router._edge_offsets[from + 1u]; ++e) {
+				addArc(from, router._edges[e].to, NO_VERTEX, router._edges[e].weight);
+			}
+		}
+	}
+
+	RoutingHierarchy run() {
+		const uint32_t vertex_count = static_cast<uint32_t>(_out.size());
+		std::greater<std::pair<int64_t, uint32_t>> later;
+		std::vector<std::pair<int64_t, uint32_t>> queue;
+		queue.reserve(vertex_count);
+		for (uint32_t vertex = 0; vertex < vertex_count; ++vertex) {
+			queue.push_back({ priority(vertex), vertex });
+		}
+		std::make_heap(queue.begin(), queue.end(), later);
+
+		std::vector<std::vector<HierarchyEdge>> up(vertex_count);
+		std::vector<std::vector<HierarchyEdge>> down(vertex_count);
+		while (!queue.empty()) {
+			std::pop_heap(queue.begin(), queue.end(), later);
+			const uint32_t vertex = queue.back().second;
+			queue.pop_back();
+			// Priorities go stale as neighbours are contracted; a vertex that got worse waits its turn.
+			const int64_t current = priority(vertex);
+			if (!queue.empty() && current > queue.front().first) {
+				queue.push_back({ current, vertex });
+				std::push_heap(queue.begin(), queue.end(), later);
+				continue;
+			}
+
+			contract(vertex, true);
+			auto lift = [this, vertex](uint32_t neighbour) {
+				++_contracted_neighbours[neighbour];
+				_levels[neighbour] = std::max(_levels[neighbour], _levels[vertex] + 1u);
+			};
+			for (const Arc& arc : _out[vertex]) {
+				up[vertex].push_back({ arc.to, arc.middle, arc.weight });
+				detach(_in[arc.to], vertex);
+				lift(arc.to);
+			}
+			for (const Arc& arc : _in[vertex]) {
+				down[vertex].push_back({ arc.to, arc.middle, arc.weight });
+				detach(_out[arc.to], vertex);
+				lift(arc.to);
+			}
+			std::vector<Arc>().swap(_out[vertex]);
+			std::vector<Arc>().swap(_in[vertex]);
+		}
+
+		RoutingHierarchy res;
+		res.info = { _router._settings, _router._stop_count, 0u };
+		res.call_buses = _router._call_buses;
+		auto flatten = [vertex_count](const std::vector<std::vector<HierarchyEdge>>& rows, std::vector<uint32_t>& offsets, std::vector<HierarchyEdge>& edges) {
+			offsets.reserve(vertex_count + 1u);
+			offsets.push_back(0u);
+			for (const std::vector<HierarchyEdge>& row : rows) {
+				edges.insert(edges.end(), row.cbegin(), row.cend());
+				offsets.push_back(static_cast<uint32_t>(edges.size()));
+			}
+		};
+		flatten(up, res.up_offsets, res.up_edges);
+		flatten(down, res.down_offsets, res.down_edges);
+		return res;
+	}
+
+private:
+	struct Arc {
+		uint32_t to;
+		uint32_t middle;
+		double weight;
+	};
+
+	static void detach(std::vector<Arc>& arcs, uint32_t vertex) {
+		arcs.erase(std::remove_if(arcs.begin(), arcs.end(), [vertex](const Arc& arc) { return arc.to == vertex; }), arcs.end());
+	}
+
+	// Keeps one arc per pair of vertices, the lightest.
+	void addArc(uint32_t from, uint32_t to, uint32_t middle, double weight) {
+		auto out = std::find_if(_out[from].begin(), _out[from].end(), [to](const Arc& arc) { return arc.to == to; });
+		if (out == _out[from].end()) {
+			_out[from].push_back({ to, middle, weight });
+			_in[to].push_back({ from, middle, weight });
+			return;
+		}
+		if (weight < out->weight) {
+			*out = { to, middle, weight };
+			auto in = std::find_if(_in[to].begin(), _in[to].end(), [from](const Arc& arc) { return arc.to == from; });
+			*in = { from, middle, weight };
+		}
+	}
+
+	// Labels what source reaches within limit without passing through skip.
+	void findWitnesses(uint32_t source, uint32_t skip, double limit) {
+		_witness.reset(_out.size());
+		_witness.reach(source, 0.0, source, NO_VERTEX);
+		size_t settled = 0;
+		double t;
+		uint32_t vertex;
+		while (_witness.settle(t, vertex) && t <= limit && settled++ < WITNESS_SETTLE_LIMIT) {
+			for (const Arc& arc : _out[vertex]) {
+				if (arc.to != skip) {
+					_witness.reach(arc.to, t + arc.weight, vertex, NO_VERTEX);
+				}
+			}
+		}
+	}
+
+	// Number of shortcuts contracting vertex needs; with apply they are added.
+	size_t contract(uint32_t vertex, bool apply) {
+		size_t shortcuts = 0;
+		for (size_t i = 0; i < _in[vertex].size(); ++i) {
+			const Arc in = _in[vertex][i];
+			double limit = -1.0;
+			for (const Arc& out : _out[vertex]) {
+				if (out.to != in.to) {
+					limit = std::max(limit, in.weight + out.weight);
+				}
+			}
+			if (limit < 0.0) {
+				continue;
+			}
+			findWitnesses(in.to, vertex, limit);
+			for (size_t j = 0; j < _out[vertex].size(); ++j) {
+				const Arc out = _out[vertex][j];
+				if (out.to == in.to || _witness.timeOf(out.to) <= in.weight + out.weight) {
+					continue;
+				}
+				++shortcuts;
+				if (apply) {
+					addArc(in.to, out.to, vertex, in.weight + out.weight);
+				}
+			}
+		}
+		return shortcuts;
+	}
+
+	// Edge difference, plus contracted neighbours and level, which spread contraction evenly over the
+	// graph and keep the hierarchy shallow.
+	int64_t priority(uint32_t vertex) {
+		return static_cast<int64_t>(contract(vertex, false))
+			- static_cast<int64_t>(_in[vertex].size() + _out[vertex].size())
+			+ _contracted_neighbours[vertex]
+			+ _levels[vertex];
+	}
+
+	const TransportRouter& _router;
+	std::vector<std::vector<Arc>> _out;
+	std::vector<std::vector<Arc>> _in;
+	std::vector<uint32_t> _contracted_neighbours;
+	// One more than the highest level among the contracted neighbours.
+	std::vector<uint32_t> _levels;
+	SearchState _witness;
+};
+
+TransportRouter::TransportRouter(const TransportCatalogue& catalogue, const RoutingSettings& settings)
+	: TransportRouter(catalogue, settings, true) {}
+
+TransportRouter::TransportRouter(const TransportCatalogue& catalogue, const RoutingSettings& settings, bool use_hierarchy)
+	: _settings(settings), _generation(catalogue.generation()), _stop_count(0) {
+	if (!catalogue.isFinalized()) {
+		throw std::logic_error("TransportRouter needs a finalized catalogue"s);
+	}
+	if (!(settings.bus_velocity > 0.0) || settings.bus_wait_time < 0.0) {
+		throw std::invalid_argument("Routing needs a positive bus velocity and a non-negative wait time"s);
+	}
+	const RoutingHierarchyView& hierarchy = catalogue.routingHierarchy();
+	if (use_hierarchy
+		&& !hierarchy.empty()
+		&& hierarchy.info.settings.bus_wait_time == settings.bus_wait_time
+		&& hierarchy.info.settings.bus_velocity == settings.bus_velocity) {
+		_hierarchy = hierarchy;
+		_stop_count = hierarchy.info.stop_count;
+	}
+	else {
+		compileGraph(catalogue);
+	}
+}
+
+const RoutingSettings& TransportRouter::settings() const {
+	return _settings;
+}
+
+uint64_t TransportRouter::generation() const {
+	return _generation;
+}
+
+bool TransportRouter::usesHierarchy() const {
+	return !_hierarchy.empty();
+}
+
+RoutingHierarchy TransportRouter::Contract(const TransportCatalogue& catalogue, const RoutingSettings& settings) {
+	TransportRouter router(catalogue, settings, false);
+	return Contractor(router).run();
+}
+
+void TransportRouter::compileGraph(const TransportCatalogue& catalogue) {
+	const CatalogueView& l = *catalogue.getAllRoutesInfoRef().layout;
+	_stop_count = static_cast<uint32_t>(l.stopCount());
+	const double meters_per_minute = _settings.bus_velocity * 1000.0 / 60.0;
+
+	std::vector<std::pair<uint32_t, Edge>> edges;
+	std::vector<StopIdx> calls;
+	auto add_direction = [&](BusIdx bus) {
+		if (calls.size() < 2u) {
+			return;
+		}
+		const uint32_t first = _stop_count + static_cast<uint32_t>(_call_buses.size());
+		for (uint32_t i = 0; i < calls.size(); ++i) {
+			_call_buses.push_back(bus);
+			if (i + 1u < calls.size()) {
+				edges.push_back({ calls[i], { first + i, _settings.bus_wait_time } });
+				edges.push_back({ first + i, { first + i + 1u, catalogue.getFromDistanceOrLength(calls[i], calls[i + 1u]) / meters_per_minute } });
+			}
+			if (i > 0u) {
+				edges.push_back({ first + i, { calls[i], 0.0 } });
+			}
+		}
+	};
+	for (BusIdx bus = 0; bus < l.busCount(); ++bus) {
+		RouteRef route = l.route(bus);
+		calls.assign(route.stops.begin(), route.stops.end());
+		if (route.isRouteCircle) {
+			if (!calls.empty()) {
+				calls.push_back(calls.front());
+			}
+			add_direction(bus);
+		}
+		else {
+			add_direction(bus);
+			std::reverse(calls.begin(), calls.end());
+			add_direction(bus);
+		}
+	}
+
+	// Counting sort by source; edges of a vertex keep the order they were added in.
+	const size_t vertex_count = _stop_count + _call_buses.size();
+	_edge_offsets.assign(vertex_count + 1u, 0u);
+	for (const auto& [from, edge] : edges) {
+		++_edge_offsets[from + 1u];
+	}
+	std::partial_sum(_edge_offsets.begin(), _edge_offsets.end(), _edge_offsets.begin());
+	std::vector<uint32_t> fill(_edge_offsets.begin(), _edge_offsets.end() - 1);
+	_edges.resize(edges.size());
+	for (const auto& [from, edge] : edges) {
+		_edges[fill[from]++] = edge;
+	}
+}
+
+BusIdx TransportRouter::callBus(uint32_t vertex) const {
+	return _hierarchy.empty() ? _call_buses[vertex - _stop_count] : _hierarchy.call_buses[vertex - _stop_count];
+}
+
+std::optional<RouteItinerary> TransportRouter::findRoute(StopIdx from, StopIdx to) const {
+	if (from >= _stop_count || to >= _stop_count) {
+		throw std::out_of_range("Stop id out of the routing graph"s);
+	}
+	if (from == to) {
+		return RouteItinerary{ 0.0, {} };
+	}
+
+	thread_local std::vector<PathEdge> path;
+	path.clear();
+	const bool found = _hierarchy.empty() ? findGraphPath(from, to, path) : findHierarchyPath(from, to, path);
+	if (!found) {
+		return std::nullopt;
+	}
+
+	// With a zero wait, boarding and alighting at the same stop costs nothing and may tie with the
+	// journey without it; such empty rides are dropped.
+	auto drop_empty_ride = [](RouteItinerary& itinerary) {
+		if (!itinerary.legs.empty() && itinerary.legs.back().span_count == 0u) {
+			itinerary.legs.resize(itinerary.legs.size() - 2u);
+		}
+	};
+	RouteItinerary res{ 0.0, {} };
+	for (const PathEdge& edge : path) {
+		res.total_time += edge.weight;
+		if (edge.from < _stop_count) {
+			drop_empty_ride(res);
+			res.legs.push_back({ RouteLegType::Wait, edge.from, 0u, 0u, edge.weight });
+			res.legs.push_back({ RouteLegType::Ride, edge.from, callBus(edge.to), 0u, 0.0 });
+		}
+		else if (edge.to >= _stop_count) {
+			RouteLeg& ride = res.legs.back();
+			++ride.span_count;
+			ride.time += edge.weight;
+		}
+	}
+	drop_empty_ride(res);
+	return res;
+}
+
+// Dijkstra over the stops from from, until settle(stop, time) returns true or every reachable stop is
+// settled. The labels are left in GraphState().
+template<typename SettleFn>
+void TransportRouter::searchGraph(StopIdx from, SettleFn&& settle) const {
+	SearchState& state = GraphState();
+	state.reset(_edge_offsets.size() - 1u);
+	state.reach(from, 0.0, from, NO_VERTEX);
+	double time;
+	uint32_t stop;
+	while (state.settle(time, stop)) {
+		if (settle(stop, time)) {
+			return;
+		}
+		// Only stops go through the queue. Calls after a boarding are labelled in place down the bus,
+		// until a call is met that an earlier boarding already reaches no later.
+		for (uint32_t board = _edge_offsets[stop]; board < _edge_offsets[stop + 1u]; ++board) {
+			uint32_t parent = stop;
+			uint32_t parent_edge = board;
+			uint32_t call = _edges[board].to;
+			double call_time = time + _edges[board].weight;
+			while (call != NO_VERTEX && !(state.reached(call) && state.time[call] <= call_time)) {
+				state.stamp[call] = state.current;
+				state.time[call] = call_time;
+				state.parent[call] = parent;
+				state.parent_edge[call] = parent_edge;
+				parent = call;
+				uint32_t next = NO_VERTEX;
+				for (uint32_t e = _edge_offsets[call]; e < _edge_offsets[call + 1u]; ++e) {
+					if (_edges[e].to < _stop_count) {
+						state.reach(_edges[e].to, call_time, call, e);
+					}
+					else {
+						next = _edges[e].to;
+						parent_edge = e;
+					}
+				}
+				if (next != NO_VERTEX) {
+					call_time += _edges[parent_edge].weight;
+				}
+				call = next;
+			}
+		}
+	}
+}
+
+bool TransportRouter::findGraphPath(StopIdx from, StopIdx to, std::vector<PathEdge>& path) const {
+	bool found = false;
+	searchGraph(from, [to, &found](StopIdx stop, double) { return found = stop == to; });
+	if (!found) {
+		return false;
+	}
+
+	const SearchState& state = GraphState();
+	for (uint32_t vertex = to; vertex != from; vertex = state.parent[vertex]) {
+		path.push_back({ state.parent[vertex], vertex, _edges[state.parent_edge[vertex]].weight });
+	}
+	std::reverse(path.begin(), path.end());
+	return true;
+}
+
+bool TransportRouter::findHierarchyPath(StopIdx from, StopIdx to, std::vector<PathEdge>& path) const {
+	thread_local SearchState forward;
+	thread_local SearchState backward;
+	const size_t vertex_count = _hierarchy.vertexCount();
+	forward.reset(vertex_count);
+	backward.reset(vertex_count);
+	forward.reach(from, 0.0, from, NO_VERTEX);
+	backward.reach(to, 0.0, to, NO_VERTEX);
+
+	// Forward climbs the up edges from the source, backward the down edges from the target, and they
+	// meet at the highest-ranked vertex of the journey. A side stops once it cannot beat the best meeting.
+	double best = UNREACHED;
+	uint32_t meeting = NO_VERTEX;
+	while (std::min(forward.nextTime(), backward.nextTime()) < best) {
+		const bool is_forward = forward.nextTime() <= backward.nextTime();
+		SearchState& state = is_forward ? forward : backward;
+		const SearchState& other = is_forward ? backward : forward;
+		Span<uint32_t> offsets = is_forward ? _hierarchy.up_offsets : _hierarchy.down_offsets;
+		Span<HierarchyEdge> edges = is_forward ? _hierarchy.up_edges : _hierarchy.down_edges;
+		double time;
+		uint32_t vertex;
+		if (!state.settle(time, vertex)) {
+			continue;
+		}
+		if (time + other.timeOf(vertex) < best) {
+			best = time + other.timeOf(vertex);
+			meeting = vertex;
+		}
+		for (uint32_t e = offsets[vertex]; e < offsets[vertex + 1u]; ++e) {
+			state.reach(edges[e].to, time + edges[e].weight, vertex, e);
+		}
+	}
+	if (meeting == NO_VERTEX) {
+		return false;
+	}
+
+	for (uint32_t vertex = meeting; vertex != from; vertex = forward.parent[vertex]) {
+		path.push_back({ forward.parent[vertex], vertex, 0.0 });
+	}
+	std::reverse(path.begin(), path.end());
+	std::vector<PathEdge> hops(path.begin(), path.end());
+	path.clear();
+	for (const PathEdge& hop : hops) {
+		unpackHierarchyEdge(hop.from, _hierarchy.up_edges[forward.parent_edge[hop.to]], path);
+	}
+	for (uint32_t vertex = meeting; vertex != to; vertex = backward.parent[vertex]) {
+		const HierarchyEdge& edge = _hierarchy.down_edges[backward.parent_edge[vertex]];
+		unpackHierarchyEdge(vertex, { backward.parent[vertex], edge.middle, edge.weight }, path);
+	}
+	return true;
+}
+
+void TransportRouter::unpackHierarchyEdge(uint32_t from, const HierarchyEdge& edge, std::vector<PathEdge>& path) const {
+	if (edge.middle == NO_VERTEX) {
+		path.push_back({ from, edge.to, edge.weight });
+		return;
+	}
+	// A shortcut bypasses a vertex ranked below both ends: its first half is a down edge of the
+	// middle, its second half an up edge.
+	const uint32_t middle = edge.middle;
+	const HierarchyEdge* down_begin = _hierarchy.down_edges.data() + _hierarchy.down_offsets[middle];
+	const HierarchyEdge* down_end = _hierarchy.down_edges.data() + _hierarchy.down_offsets[middle + 1u];
+	const HierarchyEdge* up_begin = _hierarchy.up_edges.data() + _hierarchy.up_offsets[middle];
+	const HierarchyEdge* up_end = _hierarchy.up_edges.data() + _hierarchy.up_offsets[middle + 1u];
+	const HierarchyEdge* first = std::find_if(down_begin, down_end, [from](const HierarchyEdge& e) { return e.to == from; });
+	const HierarchyEdge* second = std::find_if(up_begin, up_end, [&edge](const HierarchyEdge& e) { return e.to == edge.to; });
+	if (first == down_end || second == up_end || path.size() > _hierarchy.vertexCount()) {
+		throw std::runtime_error("Routing hierarchy does not match its shortcuts"s);
+	}
+	unpackHierarchyEdge(from, { middle, first->middle, first->weight }, path);
+	unpackHierarchyEdge(middle, *second, path);
+}
+
+std::vector<double> TransportRouter::findTravelTimes(const std::vector<StopIdx>& origins, const std::vector<StopIdx>& destinations) const {
+	return findTravelTimes(std::execution::seq, origins, destinations);
+}
+
+TransportRouter::MatrixTargets TransportRouter::prepareMatrix(const std::vector<StopIdx>& origins, const std::vector<StopIdx>& destinations) const {
+	auto out_of_range = [this](StopIdx stop) { return stop >= _stop_count; };
+	if (std::any_of(origins.cbegin(), origins.cend(), out_of_range) || std::any_of(destinations.cbegin(), destinations.cend(), out_of_range)) {
+		throw std::out_of_range("Stop id out of the routing graph"s);
+	}
+	MatrixTargets res;
+	res.stops = destinations;
+	std::sort(res.stops.begin(), res.stops.end());
+	res.stops.erase(std::unique(res.stops.begin(), res.stops.end()), res.stops.end());
+	if (_hierarchy.empty()) {
+		return res;
+	}
+
+	// Counting sort of what the destinations reach by vertex.
+	const size_t vertex_count = _hierarchy.vertexCount();
+	std::vector<std::pair<uint32_t, BucketEntry>> reached;
+	SearchState state;
+	for (uint32_t destination = 0; destination < res.stops.size(); ++destination) {
+		SearchUpward(state, vertex_count, res.stops[destination], _hierarchy.down_offsets, _hierarchy.down_edges, [&reached, destination](uint32_t vertex, double time) {
+			reached.push_back({ vertex, { destination, time } });
+		});
+	}
+	res.bucket_offsets.assign(vertex_count + 1u, 0u);
+	for (const auto& [vertex, entry] : reached) {
+		++res.bucket_offsets[vertex + 1u];
+	}
+	std::partial_sum(res.bucket_offsets.begin(), res.bucket_offsets.end(), res.bucket_offsets.begin());
+	std::vector<uint32_t> fill(res.bucket_offsets.begin(), res.bucket_offsets.end() - 1);
+	res.buckets.resize(reached.size());
+	for (const auto& [vertex, entry] : reached) {
+		res.buckets[fill[vertex]++] = entry;
+	}
+	return res;
+}
+
+void TransportRouter::fillMatrixRow(StopIdx origin, const std::vector<StopIdx>& destinations, const MatrixTargets& targets, double* row) const {
+	// Times to the distinct destinations, in the order of targets.stops.
+	thread_local std::vector<double> times;
+	times.assign(targets.stops.size(), UNREACHED);
+	if (_hierarchy.empty()) {
+		size_t settled = 0;
+		searchGraph(origin, [&](StopIdx stop, double time) {
+			auto it = std::lower_bound(targets.stops.cbegin(), targets.stops.cend(), stop);
+			if (it != targets.stops.cend() && *it == stop) {
+				times[it - targets.stops.cbegin()] = time;
+				++settled;
+			}
+			return settled == targets.stops.size();
+		});
+	}
+	else {
+		thread_local SearchState state;
+		SearchUpward(state, _hierarchy.vertexCount(), origin, _hierarchy.up_offsets, _hierarchy.up_edges, [&](uint32_t vertex, double time) {
+			for (uint32_t b = targets.bucket_offsets[vertex]; b < targets.bucket_offsets[vertex + 1u]; ++b) {
+				const BucketEntry& entry = targets.buckets[b];
+				times[entry.destination] = std::min(times[entry.destination], time + entry.time);
+			}
+		});
+	}
+	for (size_t j = 0; j < destinations.size(); ++j) {
+		row[j] = times[std::lower_bound(targets.stops.cbegin(), targets.stops.cend(), destinations[j]) - targets.stops.cbegin()];
+	}
+}
+
+std::vector<std::pair<StopIdx, double>> TransportRouter::findReachable(StopIdx from, double max_time) const {
+	if (!_hierarchy.empty()) {
+		throw std::logic_error("Reachable stops need a router built without the routing hierarchy"s);
+	}
+	if (from >= _stop_count) {
+		throw std::out_of_range("Stop id out of the routing graph"s);
+	}
+	std::vector<std::pair<StopIdx, double>> res;
+	searchGraph(from, [max_time, &res](StopIdx stop, double time) {
+		if (time > max_time) {
+			return true;
+		}
+		res.push_back({ stop, time });
+		return false;
+	});
+	return res;
+}
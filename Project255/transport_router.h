@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <numeric>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "domain.h"
+#include "transport_catalogue.h"
+
+enum class RouteLegType {
+	Wait,
+	Ride
+};
+
+// Wait: time spent at stop before boarding. Ride: span_count segments on bus, boarded at stop.
+struct RouteLeg {
+	RouteLegType type;
+	StopIdx stop;
+	BusIdx bus;
+	uint32_t span_count;
+	double time;
+};
+
+struct RouteItinerary {
+	double total_time;
+	std::vector<RouteLeg> legs;
+};
+
+// Fastest journeys between the stops of a finalized catalogue, in minutes: settings.bus_wait_time
+// at the stop before every boarding, then settings.bus_velocity along road distances.
+//
+// The graph is kept in CSR form. Vertices [0, stopCount) are the stops; every direction of every bus
+// adds one call vertex per stop on it. A stop links to the calls at it with the wait, a call to the
+// next call of its bus with the ride and back to its stop for free, so the edge count stays linear in
+// the route lengths. Queries may be issued from several threads.
+//
+// When the catalogue carries a routing hierarchy built with the same settings (see Contract()),
+// queries run a bidirectional search over it and the graph itself is not built. Otherwise they run
+// Dijkstra over the stops, scanning the calls after a boarding along the bus instead of queueing them.
+class TransportRouter {
+public:
+	// The catalogue has to outlive the router and stay unchanged while it is in use; see generation().
+	TransportRouter(const TransportCatalogue& catalogue, const RoutingSettings& settings);
+	// With use_hierarchy false the routing hierarchy of the catalogue is ignored and the graph is built,
+	// as findReachable() needs.
+	TransportRouter(const TransportCatalogue& catalogue, const RoutingSettings& settings, bool use_hierarchy);
+
+	// Origin count from which findTravelTimes() is worth running on the parallel execution policy.
+	static constexpr size_t PARALLEL_ORIGIN_THRESHOLD = 16;
+
+	// nullopt when no bus journey links the stops. Among equally fast journeys the one returned depends
+	// on the search: the graph and the routing hierarchy may pick different ones, e.g. changing buses at
+	// another stop the two share, and such total_times agree only up to rounding of the different legs.
+	// A given router answers the same query the same way every time.
+	std::optional<RouteItinerary> findRoute(StopIdx from, StopIdx to) const;
+
+	// Row-major matrix of the travel times from every origin to every destination, infinity where no
+	// bus journey links them. A single search per origin fills its row. With a routing hierarchy the
+	// destinations are searched once up front and leave their times in buckets at the vertices they
+	// reach, which the search of an origin picks up. Origins are searched in parallel under policy.
+	std::vector<double> findTravelTimes(const std::vector<StopIdx>& origins, const std::vector<StopIdx>& destinations) const;
+	template<typename ExecutionPolicy>
+	std::vector<double> findTravelTimes(ExecutionPolicy&& policy, const std::vector<StopIdx>& origins, const std::vector<StopIdx>& destinations) const;
+
+	// Stops reachable from from within max_time, with their times, fastest first and from itself at 0.
+	// The search stops at the first stop past max_time. Throws std::logic_error on a router that uses
+	// a routing hierarchy.
+	std::vector<std::pair<StopIdx, double>> findReachable(StopIdx from, double max_time) const;
+
+	const RoutingSettings& settings() const;
+	// TransportCatalogue::generation() of the catalogue the router was built for.
+	uint64_t generation() const;
+	bool usesHierarchy() const;
+
+	// Contraction hierarchy of the graph for catalogue and settings, for
+	// TransportCatalogue::setRoutingHierarchy(). Vertices are contracted in the order of their edge
+	// difference, contracted neighbours and level, with witness searches cut at WITNESS_SETTLE_LIMIT
+	// vertices; a cut search only adds a shortcut that was not needed.
+	static RoutingHierarchy Contract(const TransportCatalogue& catalogue, const RoutingSettings& settings);
+
+private:
+	static constexpr size_t WITNESS_SETTLE_LIMIT = 64u;
+
+	struct Edge {
+		uint32_t to;
+		double weight;
+	};
+
+	struct PathEdge {
+		uint32_t from;
+		uint32_t to;
+		double weight;
+	};
+
+	class Contractor;
+
+	struct BucketEntry {
+		uint32_t destination;
+		double time;
+	};
+
+	// What findTravelTimes() searches every origin against.
+	struct MatrixTargets {
+		// The destinations, sorted and distinct.
+		std::vector<StopIdx> stops;
+		// With a hierarchy, row v of buckets spans [bucket_offsets[v], bucket_offsets[v + 1]).
+		std::vector<uint32_t> bucket_offsets;
+		std::vector<BucketEntry> buckets;
+	};
+
+	void compileGraph(const TransportCatalogue& catalogue);
+	BusIdx callBus(uint32_t vertex) const;
+	template<typename SettleFn>
+	void searchGraph(StopIdx from, SettleFn&& settle) const;
+	bool findGraphPath(StopIdx from, StopIdx to, std::vector<PathEdge>& path) const;
+	bool findHierarchyPath(StopIdx from, StopIdx to, std::vector<PathEdge>& path) const;
+	void unpackHierarchyEdge(uint32_t from, const HierarchyEdge& edge, std::vector<PathEdge>& path) const;
+	MatrixTargets prepareMatrix(const std::vector<StopIdx>& origins, const std::vector<StopIdx>& destinations) const;
+	void fillMatrixRow(StopIdx origin, const std::vector<StopIdx>& destinations, const MatrixTargets& targets, double* row) const;
+
+	RoutingSettings _settings;
+	uint64_t _generation;
+	uint32_t _stop_count;
+
+	// Row v of _edges spans [_edge_offsets[v], _edge_offsets[v + 1]).
+	std::vector<uint32_t> _edge_offsets;
+	std::vector<Edge> _edges;
+	// Bus of the call vertex _stop_count + i.
+	std::vector<BusIdx> _call_buses;
+
+	RoutingHierarchyView _hierarchy;
+};
+
+template<typename ExecutionPolicy>
+inline std::vector<double> TransportRouter::findTravelTimes(ExecutionPolicy&& policy, const std::vector<StopIdx>& origins, const std::vector<StopIdx>& destinations) const {
+	const MatrixTargets targets = prepareMatrix(origins, destinations);
+	std::vector<double> res(origins.size() * destinations.size());
+	std::vector<size_t> rows(origins.size());
+	std::iota(rows.begin(), rows.end(), size_t{ 0 });
+	std::for_each(policy, rows.cbegin(), rows.cend(), [&](size_t row) {
+		fillMatrixRow(origins[row], destinations, targets, res.data() + row * destinations.size());
+	});
+	return res;
+}